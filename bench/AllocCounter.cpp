@@ -0,0 +1,90 @@
+#include "AllocCounter.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+// glibc's internal entry points, the interposers below forward to them
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* ptr);
+}
+
+namespace
+{
+
+std::atomic<uint64_t> countAlloc{0};
+
+inline void count()
+{
+    countAlloc.fetch_add(1, std::memory_order_relaxed);
+}
+
+}
+
+namespace bplayer
+{
+
+uint64_t countAllocations()
+{
+    return countAlloc.load(std::memory_order_relaxed);
+}
+
+}
+
+extern "C" {
+
+void* malloc(size_t size)
+{
+    count();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count_, size_t size)
+{
+    count();
+    return __libc_calloc(count_, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    // Growing in place is still a trip through the allocator
+    count();
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    count();
+    void* p = __libc_memalign(alignment, size);
+    if (!p && size != 0) {
+        return ENOMEM;
+    }
+    *ptr = p;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+void* memalign(size_t alignment, size_t size)
+{
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+namespace bplayer
+{
+
+// Heap allocations made by the whole process so far
+// Counted by malloc/calloc/realloc/posix_memalign interposers in
+// AllocCounter.cpp, which covers operator new and av_malloc as well.
+uint64_t countAllocations();
+
+}
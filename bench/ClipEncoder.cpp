@@ -0,0 +1,245 @@
+#include "ClipEncoder.hpp"
+
+#include "Loader.hpp"
+
+namespace bplayer
+{
+
+ClipEncoder::ClipEncoder()
+{
+
+}
+
+ClipEncoder::~ClipEncoder()
+{
+    close();
+}
+
+bool ClipEncoder::encode(const std::string& input, const std::string& encoder,
+    const std::string& output)
+{
+    close();
+    if (!openInput(input) || !openOutput(encoder, output)) {
+        close();
+        return false;
+    }
+
+    bool ok = true;
+    auto packet = make_avpacket();
+    auto frame = make_avframe();
+    bool draining = false;
+    while (ok && !draining) {
+        int ret = av_read_frame(ctxInput_, packet.get());
+        if (ret == AVERROR_EOF) {
+            draining = true;
+        } else if (ret < 0) {
+            std::cerr << "[Clip Encoder] Failed to read input: "
+                << ffmpegErrStr(ret) << std::endl;
+            ok = false;
+            break;
+        } else if (packet->stream_index != streamInput_->index) {
+            av_packet_unref(packet.get());
+            continue;
+        }
+        ret = avcodec_send_packet(ctxDecoder_, draining ? nullptr : packet.get());
+        av_packet_unref(packet.get());
+        if (ret < 0) {
+            std::cerr << "[Clip Encoder] Failed to decode input: "
+                << ffmpegErrStr(ret) << std::endl;
+            ok = false;
+            break;
+        }
+        while ((ret = avcodec_receive_frame(ctxDecoder_, frame.get())) >= 0) {
+            ok = transcodeFrame(frame.get());
+            av_frame_unref(frame.get());
+            if (!ok) {
+                break;
+            }
+        }
+    }
+    // Flush the encoder
+    if (ok) {
+        avcodec_send_frame(ctxEncoder_, nullptr);
+        ok = writePackets();
+    }
+    if (ok) {
+        ok = av_write_trailer(ctxOutput_) >= 0;
+    }
+    close();
+    if (ok) {
+        std::cout << "[Clip Encoder] Wrote " << output << " (" << encoder << ")"
+            << std::endl;
+    }
+    return ok;
+}
+
+bool ClipEncoder::openInput(const std::string& input)
+{
+    // Default config: the file protocol, no custom IO that would die
+    // with this loader before the input context
+    PlayerConfig config;
+    Telemetry telemetry;
+    ProbeCache probeCache;
+    Loader loader(ctxInput_, config, telemetry, probeCache);
+    if (!loader.open(input)) {
+        return false;
+    }
+    int index = av_find_best_stream(ctxInput_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (index < 0) {
+        std::cerr << "[Clip Encoder] No video stream in " << input << std::endl;
+        return false;
+    }
+    streamInput_ = ctxInput_->streams[index];
+    const AVCodec* codec = avcodec_find_decoder(streamInput_->codecpar->codec_id);
+    if (!codec) {
+        std::cerr << "[Clip Encoder] No decoder for the input" << std::endl;
+        return false;
+    }
+    ctxDecoder_ = avcodec_alloc_context3(codec);
+    if (!ctxDecoder_
+        || avcodec_parameters_to_context(ctxDecoder_, streamInput_->codecpar) < 0
+        || avcodec_open2(ctxDecoder_, codec, nullptr) < 0) {
+        std::cerr << "[Clip Encoder] Failed to open the input decoder" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ClipEncoder::openOutput(const std::string& encoder, const std::string& output)
+{
+    const AVCodec* codec = avcodec_find_encoder_by_name(encoder.c_str());
+    if (!codec || codec->type != AVMEDIA_TYPE_VIDEO) {
+        std::cerr << "[Clip Encoder] Unknown video encoder: " << encoder << std::endl;
+        return false;
+    }
+    ctxEncoder_ = avcodec_alloc_context3(codec);
+    if (!ctxEncoder_) {
+        return false;
+    }
+
+    AVRational frameRate = streamInput_->avg_frame_rate;
+    if (frameRate.num <= 0 || frameRate.den <= 0) {
+        frameRate = av_make_q(30, 1);
+    }
+    // Prefer 4:2:0, which is what the players' sources mostly are
+    AVPixelFormat pixFmt = AV_PIX_FMT_YUV420P;
+    if (codec->pix_fmts) {
+        pixFmt = codec->pix_fmts[0];
+        for (const AVPixelFormat* p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+            if (*p == AV_PIX_FMT_YUV420P || *p == AV_PIX_FMT_YUVJ420P) {
+                pixFmt = *p;
+                break;
+            }
+        }
+    }
+    ctxEncoder_->width = ctxDecoder_->width;
+    ctxEncoder_->height = ctxDecoder_->height;
+    ctxEncoder_->pix_fmt = pixFmt;
+    ctxEncoder_->time_base = av_inv_q(frameRate);
+    ctxEncoder_->framerate = frameRate;
+    ctxEncoder_->gop_size = GOP_SIZE;
+    ctxEncoder_->bit_rate = static_cast<int64_t>(BITS_PER_PIXEL
+        * ctxEncoder_->width * ctxEncoder_->height * av_q2d(frameRate));
+
+    if (avformat_alloc_output_context2(&ctxOutput_, nullptr, "matroska",
+        output.c_str()) < 0) {
+        std::cerr << "[Clip Encoder] Failed to create " << output << std::endl;
+        return false;
+    }
+    if (ctxOutput_->oformat->flags & AVFMT_GLOBALHEADER) {
+        ctxEncoder_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    int ret = avcodec_open2(ctxEncoder_, codec, nullptr);
+    if (ret < 0) {
+        std::cerr << "[Clip Encoder] Failed to open encoder " << encoder << ": "
+            << ffmpegErrStr(ret) << std::endl;
+        return false;
+    }
+    streamOutput_ = avformat_new_stream(ctxOutput_, nullptr);
+    if (!streamOutput_
+        || avcodec_parameters_from_context(streamOutput_->codecpar, ctxEncoder_) < 0) {
+        return false;
+    }
+    streamOutput_->time_base = ctxEncoder_->time_base;
+    if (!(ctxOutput_->oformat->flags & AVFMT_NOFILE)
+        && avio_open(&ctxOutput_->pb, output.c_str(), AVIO_FLAG_WRITE) < 0) {
+        std::cerr << "[Clip Encoder] Failed to open " << output << std::endl;
+        return false;
+    }
+    if (avformat_write_header(ctxOutput_, nullptr) < 0) {
+        return false;
+    }
+
+    frameEncode_ = make_avframe();
+    frameEncode_->width = ctxEncoder_->width;
+    frameEncode_->height = ctxEncoder_->height;
+    frameEncode_->format = ctxEncoder_->pix_fmt;
+    return av_frame_get_buffer(frameEncode_.get(), 32) >= 0;
+}
+
+bool ClipEncoder::transcodeFrame(const AVFrame* frame)
+{
+    ctxScaler_ = sws_getCachedContext(ctxScaler_,
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        ctxEncoder_->width, ctxEncoder_->height, ctxEncoder_->pix_fmt,
+        SWS_BICUBIC, nullptr, nullptr, nullptr);
+    if (!ctxScaler_ || av_frame_make_writable(frameEncode_.get()) < 0) {
+        return false;
+    }
+    sws_scale(ctxScaler_, frame->data, frame->linesize, 0, frame->height,
+        frameEncode_->data, frameEncode_->linesize);
+    int64_t pts = frame->best_effort_timestamp != AV_NOPTS_VALUE
+        ? frame->best_effort_timestamp : frame->pts;
+    frameEncode_->pts = pts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE
+        : av_rescale_q(pts, streamInput_->time_base, ctxEncoder_->time_base);
+    int ret = avcodec_send_frame(ctxEncoder_, frameEncode_.get());
+    if (ret < 0) {
+        std::cerr << "[Clip Encoder] Failed to encode: " << ffmpegErrStr(ret)
+            << std::endl;
+        return false;
+    }
+    return writePackets();
+}
+
+bool ClipEncoder::writePackets()
+{
+    auto packet = make_avpacket();
+    while (true) {
+        int ret = avcodec_receive_packet(ctxEncoder_, packet.get());
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return true;
+        }
+        if (ret < 0) {
+            return false;
+        }
+        av_packet_rescale_ts(packet.get(), ctxEncoder_->time_base,
+            streamOutput_->time_base);
+        packet->stream_index = streamOutput_->index;
+        if (av_interleaved_write_frame(ctxOutput_, packet.get()) < 0) {
+            return false;
+        }
+    }
+}
+
+void ClipEncoder::close()
+{
+    frameEncode_.reset();
+    sws_freeContext(ctxScaler_);
+    ctxScaler_ = nullptr;
+    avcodec_free_context(&ctxDecoder_);
+    avcodec_free_context(&ctxEncoder_);
+    if (ctxInput_) {
+        avformat_close_input(&ctxInput_);
+    }
+    if (ctxOutput_) {
+        if (!(ctxOutput_->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&ctxOutput_->pb);
+        }
+        avformat_free_context(ctxOutput_);
+        ctxOutput_ = nullptr;
+    }
+    streamInput_ = nullptr;
+    streamOutput_ = nullptr;
+}
+
+}
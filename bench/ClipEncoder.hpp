@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+namespace bplayer
+{
+
+// Re-encodes the first video stream of an input (file or "lavfi:<graph>")
+// into a Matroska clip, so the benchmark can exercise real decoders.
+class ClipEncoder {
+public:
+    ClipEncoder();
+    ~ClipEncoder();
+
+    // "encoder" is an FFmpeg encoder name, e.g. mpeg4, mjpeg, libx264
+    bool encode(const std::string& input, const std::string& encoder,
+        const std::string& output);
+
+private:
+    // Bits per pixel of the target bit rate
+    static constexpr double BITS_PER_PIXEL = 0.1;
+    static constexpr int GOP_SIZE = 30;
+
+    AVFormatContext* ctxInput_ = nullptr;
+    AVFormatContext* ctxOutput_ = nullptr;
+    AVCodecContext* ctxDecoder_ = nullptr;
+    AVCodecContext* ctxEncoder_ = nullptr;
+    SwsContext* ctxScaler_ = nullptr;
+    AVStream* streamInput_ = nullptr;
+    AVStream* streamOutput_ = nullptr;
+    std::shared_ptr<AVFrame> frameEncode_;
+
+    bool openInput(const std::string& input);
+    bool openOutput(const std::string& encoder, const std::string& output);
+    bool transcodeFrame(const AVFrame* frame);
+    bool writePackets();
+    void close();
+};
+
+}
@@ -0,0 +1,195 @@
+#include "KernelCheck.hpp"
+
+#include "ScalerRGB565.hpp"
+#include "SliceWorkers.hpp"
+#include "Timer.hpp"
+
+#include <cmath>
+
+namespace bplayer
+{
+
+KernelCheck::KernelCheck(double minPsnr)
+    : minPsnr_(minPsnr)
+{
+
+}
+
+KernelCheck::~KernelCheck()
+{
+
+}
+
+bool KernelCheck::run()
+{
+    // Common sources onto the ST7735S landscape/portrait areas
+    static constexpr int SIZES[][4] = {
+        {1920, 1080, 160, 90},
+        {1280, 720, 160, 90},
+        {640, 480, 160, 120},
+        {640, 360, 128, 72},
+        {352, 288, 128, 104},
+        {1080, 1920, 72, 128},
+        {176, 144, 160, 128},
+    };
+    bool ok = true;
+    results_.clear();
+    for (const auto& size : SIZES) {
+        ok = checkSize(size[0], size[1], size[2], size[3]) && ok;
+    }
+    return ok;
+}
+
+void KernelCheck::writeJson(std::ostream& os) const
+{
+    os << "{\n  \"kernel\": \"" << ScalerRGB565::getKernelName() << "\",\n"
+        << "  \"minPsnr\": " << minPsnr_ << ",\n  \"sizes\": [\n";
+    for (size_t i = 0; i < results_.size(); i++) {
+        const Result& r = results_[i];
+        os << "    {\"src\": \"" << r.widthSrc << "x" << r.heightSrc
+            << "\", \"dst\": \"" << r.widthDst << "x" << r.heightDst
+            << "\", \"psnr\": " << r.psnr
+            << ", \"meanAbs\": " << r.meanAbs
+            << ", \"maxAbs\": " << r.maxAbs
+            << ", \"usNative\": " << r.usNative
+            << ", \"usNativeSliced\": " << r.usNativeSliced
+            << ", \"usSwscale\": " << r.usSwscale
+            << ", \"slicedMatch\": " << (r.slicedMatch ? "true" : "false")
+            << ", \"pass\": " << (r.pass ? "true" : "false") << "}"
+            << (i + 1 < results_.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}" << std::endl;
+}
+
+// Gradients, a chroma sweep and fine stripes, so that both the filter
+// and the matrix show up in the error
+void KernelCheck::fillPattern(AVFrame* frame)
+{
+    const int w = frame->width;
+    const int h = frame->height;
+    for (int y = 0; y < h; y++) {
+        uint8_t* row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < w; x++) {
+            int value = 16 + (x * 219 / w + y * 219 / h) / 2;
+            if ((x / 3 + y / 5) % 7 == 0) {
+                value = 235 - value / 4;
+            }
+            row[x] = static_cast<uint8_t>(value);
+        }
+    }
+    for (int y = 0; y < (h + 1) / 2; y++) {
+        uint8_t* rowU = frame->data[1] + y * frame->linesize[1];
+        uint8_t* rowV = frame->data[2] + y * frame->linesize[2];
+        for (int x = 0; x < (w + 1) / 2; x++) {
+            rowU[x] = static_cast<uint8_t>(16 + x * 224 / ((w + 1) / 2));
+            rowV[x] = static_cast<uint8_t>(240 - y * 224 / ((h + 1) / 2));
+        }
+    }
+}
+
+bool KernelCheck::checkSize(int widthSrc, int heightSrc, int widthDst, int heightDst)
+{
+    Result result{widthSrc, heightSrc, widthDst, heightDst, 
+        0.0, 0.0, 0, 0.0, 0.0, 0.0, false, false};
+    auto src = make_avframe();
+    auto dstNative = make_avframe();
+    auto dstSliced = make_avframe();
+    auto dstSwscale = make_avframe();
+    src->width = widthSrc;
+    src->height = heightSrc;
+    src->format = AV_PIX_FMT_YUV420P;
+    src->colorspace = AVCOL_SPC_BT470BG;
+    src->color_range = AVCOL_RANGE_MPEG;
+    for (auto& dst : {dstNative, dstSliced, dstSwscale}) {
+        dst->width = widthDst;
+        dst->height = heightDst;
+        dst->format = AV_PIX_FMT_RGB565BE;
+    }
+    if (av_frame_get_buffer(src.get(), 32) < 0
+        || av_frame_get_buffer(dstNative.get(), 32) < 0
+        || av_frame_get_buffer(dstSliced.get(), 32) < 0
+        || av_frame_get_buffer(dstSwscale.get(), 32) < 0) {
+        std::cerr << "[Kernel Check] Failed to allocate frames" << std::endl;
+        return false;
+    }
+    fillPattern(src.get());
+
+    ScalerRGB565 native;
+    ScalerRGB565 sliced;
+    SliceWorkers workers;
+    workers.start(SLICES_CHECK);
+    if (!native.init(widthSrc, heightSrc, AV_PIX_FMT_YUV420P, widthDst, heightDst)
+        || !sliced.init(widthSrc, heightSrc, AV_PIX_FMT_YUV420P, widthDst, heightDst,
+            SLICES_CHECK)) {
+        std::cerr << "[Kernel Check] Native kernel rejected " << widthSrc << "x" 
+            << heightSrc << " -> " << widthDst << "x" << heightDst << std::endl;
+        results_.push_back(result);
+        return false;
+    }
+    SwsContext* ctx = sws_getContext(widthSrc, heightSrc, AV_PIX_FMT_YUV420P,
+        widthDst, heightDst, AV_PIX_FMT_RGB565BE, SWS_AREA | SWS_ACCURATE_RND,
+        nullptr, nullptr, nullptr);
+    if (!ctx) {
+        std::cerr << "[Kernel Check] Failed to create scaler" << std::endl;
+        return false;
+    }
+    av_opt_set(ctx, "sws_dither", "none", 0);
+
+    int64_t begin = Timer::nowUs();
+    for (int i = 0; i < REPEAT_TIMING; i++) {
+        native.scale(src.get(), dstNative.get());
+    }
+    result.usNative = static_cast<double>(Timer::nowUs() - begin) / REPEAT_TIMING;
+    begin = Timer::nowUs();
+    for (int i = 0; i < REPEAT_TIMING; i++) {
+        sliced.scale(src.get(), dstSliced.get(), &workers);
+    }
+    result.usNativeSliced = static_cast<double>(Timer::nowUs() - begin) / REPEAT_TIMING;
+    begin = Timer::nowUs();
+    for (int i = 0; i < REPEAT_TIMING; i++) {
+        sws_scale(ctx, src->data, src->linesize, 0, heightSrc, 
+            dstSwscale->data, dstSwscale->linesize);
+    }
+    result.usSwscale = static_cast<double>(Timer::nowUs() - begin) / REPEAT_TIMING;
+    sws_freeContext(ctx);
+
+    // Expand 5/6/5 back to 8 bits by bit replication before comparing
+    auto expand = [](const uint8_t* p, int channel) {
+        uint16_t v = static_cast<uint16_t>((p[0] << 8) | p[1]);
+        switch (channel) {
+        case 0: { int r = v >> 11; return (r << 3) | (r >> 2); }
+        case 1: { int g = (v >> 5) & 0x3F; return (g << 2) | (g >> 4); }
+        default: { int b = v & 0x1F; return (b << 3) | (b >> 2); }
+        }
+    };
+    result.slicedMatch = true;
+    for (int y = 0; y < heightDst; y++) {
+        if (std::memcmp(dstNative->data[0] + y * dstNative->linesize[0],
+            dstSliced->data[0] + y * dstSliced->linesize[0], 2 * widthDst) != 0) {
+            result.slicedMatch = false;
+        }
+    }
+    double sumSquare = 0.0;
+    double sumAbs = 0.0;
+    for (int y = 0; y < heightDst; y++) {
+        const uint8_t* a = dstNative->data[0] + y * dstNative->linesize[0];
+        const uint8_t* b = dstSwscale->data[0] + y * dstSwscale->linesize[0];
+        for (int x = 0; x < widthDst; x++) {
+            for (int c = 0; c < 3; c++) {
+                int diff = std::abs(expand(a + 2 * x, c) - expand(b + 2 * x, c));
+                sumSquare += diff * diff;
+                sumAbs += diff;
+                result.maxAbs = std::max(result.maxAbs, diff);
+            }
+        }
+    }
+    const double samples = 3.0 * widthDst * heightDst;
+    const double mse = sumSquare / samples;
+    result.meanAbs = sumAbs / samples;
+    result.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+    result.pass = result.psnr >= minPsnr_ && result.slicedMatch;
+    results_.push_back(result);
+    return result.pass;
+}
+
+}
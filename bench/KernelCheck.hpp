@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+namespace bplayer
+{
+
+// Compares the native RGB565 kernel against swscale (area filter, no
+// dither) on synthetic 4:2:0 frames for a set of panel sizes, and the
+// sliced kernel against the single threaded one (must be identical)
+class KernelCheck {
+public:
+    struct Result {
+        int widthSrc;
+        int heightSrc;
+        int widthDst;
+        int heightDst;
+        // Over the 8 bit expanded channels
+        double psnr;
+        double meanAbs;
+        int maxAbs;
+        double usNative;
+        double usNativeSliced;
+        double usSwscale;
+        // Sliced output byte identical to the single threaded one
+        bool slicedMatch;
+        bool pass;
+    };
+
+    explicit KernelCheck(double minPsnr = MIN_PSNR_DEFAULT);
+    ~KernelCheck();
+
+    // False if any size falls below the PSNR tolerance or slices differ
+    bool run();
+    void writeJson(std::ostream& os) const;
+
+private:
+    // Ordered dither against a plain truncation stays well above this
+    static constexpr double MIN_PSNR_DEFAULT = 30.0;
+    static constexpr int REPEAT_TIMING = 20;
+    static constexpr int SLICES_CHECK = 4;
+
+    const double minPsnr_;
+    std::vector<Result> results_;
+
+    static void fillPattern(AVFrame* frame);
+    bool checkSize(int widthSrc, int heightSrc, int widthDst, int heightDst);
+};
+
+}
@@ -0,0 +1,524 @@
+#include "PlayerCore.hpp"
+
+#include "AllocCounter.hpp"
+#include "ClipEncoder.hpp"
+#include "KernelCheck.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace bplayer;
+
+namespace
+{
+
+struct Options {
+    std::string input = "lavfi:testsrc2=size=1280x720:rate=30";
+    // Seconds of a lavfi source, files always play to the end
+    double duration = 10.0;
+    std::string encoder;
+    std::string clip;
+    bool keepClip = false;
+    DisplayType displayType = DisplayType::Null;
+    AVPixelFormat pixFmt = AV_PIX_FMT_RGB565BE;
+    // 0 keeps the driver's own bus clock
+    uint32_t clockBusHz = 0;
+    int width = -1;
+    int height = -1;
+    Orientation orientation = Orientation::Landscape;
+    bool realtime = false;
+    RenderKernel renderKernel = RenderKernel::Native;
+    DitherMono ditherMono = DitherMono::FloydSteinberg;
+    // 0 = automatic
+    int threadsScaler = 0;
+    int workersRenderer = 1;
+    ThreadingDecode threadingDecode = ThreadingDecode::Auto;
+    int threadsDecode = 0;
+    LowDelay lowDelay = LowDelay::Auto;
+    // -1 = automatic selection
+    int indexStreamVideo = -1;
+    ReaderInput reader = ReaderInput::Default;
+    int sizeBufferIo = 64 * 1024;
+    int64_t sizeRingReadAhead = 0;
+    ProbeCacheMode probeCache = ProbeCacheMode::Off;
+    // Seek once, "seekAtS" into the run, < 0 = never
+    double seekAtS = -1.0;
+    double seekToS = 0.0;
+    SeekMode seekMode = SeekMode::Accurate;
+    bool checkKernel = false;
+    std::string output;
+};
+
+void printUsage()
+{
+    std::cout << "Usage: bplayer-bench [options]\n"
+        << "  --input <path|lavfi:graph>  source (default testsrc2 1280x720@30)\n"
+        << "  --duration <s>              length of a lavfi source (default 10)\n"
+        << "  --encode <encoder>          re-encode the source first (mpeg4, mjpeg, libx264, ...)\n"
+        << "  --clip <path>               where to put the encoded clip\n"
+        << "  --keep-clip                 do not delete the encoded clip\n"
+        << "  --display <panel>           rgb565 or mono null panel, st7735s or ssd1306\n"
+        << "                              virtual panel with bus timing (default rgb565)\n"
+        << "  --bus-clock <hz>            clock of the virtual panel bus\n"
+        << "  --size <w>x<h>              display area (default: fit 160x128)\n"
+        << "  --portrait                  portrait orientation\n"
+        << "  --realtime                  pace frames by pts instead of running flat out\n"
+        << "  --kernel <native|swscale>   RGB565 render kernel (default native)\n"
+        << "  --dither <mode>             mono kernel dither: threshold, bayer, fs or\n"
+        << "                              atkinson (default fs)\n"
+        << "  --scaler-threads <n>        stripes scaled concurrently, 0 = auto (default)\n"
+        << "  --render-workers <n>        renderer threads on whole frames (default 1)\n"
+        << "  --decode-threading <mode>   auto, frame, slice or off (default auto)\n"
+        << "  --decode-threads <n>        decoder threads, 0 = auto (default)\n"
+        << "  --low-delay <mode>          auto (live inputs), on or off (default auto)\n"
+        << "  --video-stream <index>      play this stream instead of the selected one\n"
+        << "  --reader <mode>             byte source of local files: default, mmap or\n"
+        << "                              uring (default: default)\n"
+        << "  --io-buffer <bytes>         buffer of the custom reader (default 65536)\n"
+        << "  --read-ahead <bytes>        ring filled ahead by an IO thread, 0 = off\n"
+        << "  --probe-cache <mode>        reuse earlier probes: off, limit or skip\n"
+        << "                              (default off)\n"
+        << "  --seek-at <s>               seek this long after the start (default never)\n"
+        << "  --seek-to <s>               media time to seek to (default 0)\n"
+        << "  --seek-mode <mode>          fast (keyframe) or accurate (default)\n"
+        << "  --check-kernel              compare the native kernel with swscale and exit\n"
+        << "  --output <file>             write the JSON report there instead of stdout\n"
+        << std::endl;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            return argv[++i];
+        };
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--input") {
+            options.input = value();
+        } else if (arg == "--duration") {
+            options.duration = std::stod(value());
+        } else if (arg == "--encode") {
+            options.encoder = value();
+        } else if (arg == "--clip") {
+            options.clip = value();
+        } else if (arg == "--keep-clip") {
+            options.keepClip = true;
+        } else if (arg == "--display") {
+            std::string display = value();
+            if (display == "mono") {
+                options.displayType = DisplayType::Null;
+                options.pixFmt = AV_PIX_FMT_MONOBLACK;
+            } else if (display == "rgb565") {
+                options.displayType = DisplayType::Null;
+                options.pixFmt = AV_PIX_FMT_RGB565BE;
+            } else if (display == "st7735s") {
+                options.displayType = DisplayType::ST7735SVirtual;
+                options.pixFmt = AV_PIX_FMT_RGB565BE;
+            } else if (display == "ssd1306") {
+                options.displayType = DisplayType::SSD1306Virtual;
+                options.pixFmt = AV_PIX_FMT_MONOBLACK;
+            } else {
+                throw std::invalid_argument("unknown display " + display);
+            }
+        } else if (arg == "--bus-clock") {
+            options.clockBusHz = static_cast<uint32_t>(std::stoul(value()));
+        } else if (arg == "--size") {
+            std::string size = value();
+            if (std::sscanf(size.c_str(), "%dx%d", &options.width, &options.height) != 2) {
+                throw std::invalid_argument("bad size " + size);
+            }
+        } else if (arg == "--portrait") {
+            options.orientation = Orientation::Portrait;
+        } else if (arg == "--realtime") {
+            options.realtime = true;
+        } else if (arg == "--kernel") {
+            std::string kernel = value();
+            if (kernel == "native") {
+                options.renderKernel = RenderKernel::Native;
+            } else if (kernel == "swscale") {
+                options.renderKernel = RenderKernel::Swscale;
+            } else {
+                throw std::invalid_argument("unknown kernel " + kernel);
+            }
+        } else if (arg == "--dither") {
+            std::string dither = value();
+            if (dither == "threshold") {
+                options.ditherMono = DitherMono::Threshold;
+            } else if (dither == "bayer") {
+                options.ditherMono = DitherMono::Bayer;
+            } else if (dither == "fs") {
+                options.ditherMono = DitherMono::FloydSteinberg;
+            } else if (dither == "atkinson") {
+                options.ditherMono = DitherMono::Atkinson;
+            } else {
+                throw std::invalid_argument("unknown dither " + dither);
+            }
+        } else if (arg == "--scaler-threads") {
+            options.threadsScaler = std::stoi(value());
+        } else if (arg == "--render-workers") {
+            options.workersRenderer = std::stoi(value());
+        } else if (arg == "--decode-threading") {
+            std::string threading = value();
+            if (threading == "auto") {
+                options.threadingDecode = ThreadingDecode::Auto;
+            } else if (threading == "frame") {
+                options.threadingDecode = ThreadingDecode::Frame;
+            } else if (threading == "slice") {
+                options.threadingDecode = ThreadingDecode::Slice;
+            } else if (threading == "off") {
+                options.threadingDecode = ThreadingDecode::Off;
+            } else {
+                throw std::invalid_argument("unknown decode threading " + threading);
+            }
+        } else if (arg == "--decode-threads") {
+            options.threadsDecode = std::stoi(value());
+        } else if (arg == "--low-delay") {
+            std::string lowDelay = value();
+            if (lowDelay == "auto") {
+                options.lowDelay = LowDelay::Auto;
+            } else if (lowDelay == "on") {
+                options.lowDelay = LowDelay::On;
+            } else if (lowDelay == "off") {
+                options.lowDelay = LowDelay::Off;
+            } else {
+                throw std::invalid_argument("unknown low delay mode " + lowDelay);
+            }
+        } else if (arg == "--video-stream") {
+            options.indexStreamVideo = std::stoi(value());
+        } else if (arg == "--reader") {
+            std::string reader = value();
+            if (reader == "default") {
+                options.reader = ReaderInput::Default;
+            } else if (reader == "mmap") {
+                options.reader = ReaderInput::Mmap;
+            } else if (reader == "uring") {
+                options.reader = ReaderInput::Uring;
+            } else {
+                throw std::invalid_argument("unknown reader " + reader);
+            }
+        } else if (arg == "--io-buffer") {
+            options.sizeBufferIo = std::stoi(value());
+        } else if (arg == "--read-ahead") {
+            options.sizeRingReadAhead = std::stoll(value());
+        } else if (arg == "--probe-cache") {
+            std::string probeCache = value();
+            if (probeCache == "off") {
+                options.probeCache = ProbeCacheMode::Off;
+            } else if (probeCache == "limit") {
+                options.probeCache = ProbeCacheMode::Limit;
+            } else if (probeCache == "skip") {
+                options.probeCache = ProbeCacheMode::Skip;
+            } else {
+                throw std::invalid_argument("unknown probe cache mode " + probeCache);
+            }
+        } else if (arg == "--seek-at") {
+            options.seekAtS = std::stod(value());
+        } else if (arg == "--seek-to") {
+            options.seekToS = std::stod(value());
+        } else if (arg == "--seek-mode") {
+            std::string seekMode = value();
+            if (seekMode == "fast") {
+                options.seekMode = SeekMode::Fast;
+            } else if (seekMode == "accurate") {
+                options.seekMode = SeekMode::Accurate;
+            } else {
+                throw std::invalid_argument("unknown seek mode " + seekMode);
+            }
+        } else if (arg == "--check-kernel") {
+            options.checkKernel = true;
+        } else if (arg == "--output") {
+            options.output = value();
+        } else {
+            throw std::invalid_argument("unknown option " + arg);
+        }
+    }
+    return true;
+}
+
+// Bound an endless lavfi source, the trim filter works after any source
+std::string resolveInput(const Options& options)
+{
+    if (options.input.compare(0, 6, "lavfi:") != 0 || options.duration <= 0) {
+        return options.input;
+    }
+    std::ostringstream os;
+    os << options.input << ",trim=duration=" << options.duration;
+    return os.str();
+}
+
+const char* readerName(ReaderInput reader)
+{
+    switch (reader) {
+    case ReaderInput::Mmap:
+        return "mmap";
+    case ReaderInput::Uring:
+        return "uring";
+    case ReaderInput::Default:
+    default:
+        return "default";
+    }
+}
+
+const char* probeCacheName(ProbeCacheMode mode)
+{
+    switch (mode) {
+    case ProbeCacheMode::Limit:
+        return "limit";
+    case ProbeCacheMode::Skip:
+        return "skip";
+    case ProbeCacheMode::Off:
+    default:
+        return "off";
+    }
+}
+
+const char* ditherName(DitherMono dither)
+{
+    switch (dither) {
+    case DitherMono::Threshold:
+        return "threshold";
+    case DitherMono::Bayer:
+        return "bayer";
+    case DitherMono::FloydSteinberg:
+        return "fs";
+    case DitherMono::Atkinson:
+        return "atkinson";
+    }
+    return "";
+}
+
+std::string escapeJson(const std::string& text)
+{
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+// Sends a stream to the buffer of another one for its lifetime
+class RedirectStream {
+public:
+    RedirectStream(std::ostream& from, std::ostream& to)
+        : from_(from), buffer_(from.rdbuf(to.rdbuf())) {}
+    ~RedirectStream() {
+        from_.rdbuf(buffer_);
+    }
+
+    RedirectStream(const RedirectStream&) = delete;
+    RedirectStream& operator=(const RedirectStream&) = delete;
+
+private:
+    std::ostream& from_;
+    std::streambuf* buffer_;
+};
+
+void writeHistogram(std::ostream& os, const Histogram::Snapshot& h)
+{
+    os << "{\"count\": " << h.count
+        << ", \"mean\": " << static_cast<int64_t>(h.mean())
+        << ", \"p50\": " << h.percentile(0.5)
+        << ", \"p99\": " << h.percentile(0.99)
+        << ", \"max\": " << h.max << "}";
+}
+
+void writeReport(std::ostream& os, const Options& options, const std::string& source,
+    const TelemetrySnapshot& snap, uint64_t allocations, int64_t initUs, int64_t wallUs)
+{
+    auto rate = [&](uint64_t items) {
+        return wallUs > 0 ? items * 1e6 / wallUs : 0.0;
+    };
+    os << "{\n";
+    os << "  \"input\": \"" << escapeJson(options.input) << "\",\n";
+    os << "  \"source\": \"" << escapeJson(source) << "\",\n";
+    os << "  \"encoder\": \"" << escapeJson(options.encoder) << "\",\n";
+    os << "  \"pixFmt\": \"" << av_get_pix_fmt_name(options.pixFmt) << "\",\n";
+    os << "  \"realtime\": " << (options.realtime ? "true" : "false") << ",\n";
+    os << "  \"renderKernel\": \"" 
+        << (options.renderKernel == RenderKernel::Native ? "native" : "swscale") << "\",\n";
+    os << "  \"ditherMono\": \"" << ditherName(options.ditherMono) << "\",\n";
+    os << "  \"threadsScaler\": " << options.threadsScaler << ",\n";
+    os << "  \"workersRenderer\": " << options.workersRenderer << ",\n";
+    os << "  \"reader\": \"" << readerName(options.reader) << "\",\n";
+    os << "  \"sizeBufferIo\": " << options.sizeBufferIo << ",\n";
+    os << "  \"sizeRingReadAhead\": " << options.sizeRingReadAhead << ",\n";
+    os << "  \"probeCache\": \"" << probeCacheName(options.probeCache) << "\",\n";
+    // Open, probe and pipeline setup: what the reader shortens at startup
+    os << "  \"initMs\": " << initUs / 1000.0 << ",\n";
+    os << "  \"wallMs\": " << wallUs / 1000 << ",\n";
+    os << "  \"framesDisplayed\": " << snap.framesDisplayed << ",\n";
+    os << "  \"fps\": {";
+    for (size_t i = 0; i < snap.stages.size(); i++) {
+        os << (i ? ", " : "") << "\"" << stageName(static_cast<Stage>(i)) << "\": "
+            << rate(snap.stages[i].items);
+    }
+    os << "},\n";
+    os << "  \"stages\": {\n";
+    for (size_t i = 0; i < snap.stages.size(); i++) {
+        const auto& s = snap.stages[i];
+        os << "    \"" << stageName(static_cast<Stage>(i)) << "\": {"
+            << "\"items\": " << s.items
+            << ", \"dropped\": " << s.dropped
+            << ", \"cpuMs\": " << s.cpuUs / 1000.0
+            << ", \"cpuUsPerItem\": " << (s.items ? s.cpuUs / s.items : 0)
+            << ", \"threads\": " << s.threads
+            << ", \"mode\": \"" << escapeJson(s.mode) << "\""
+            << ",\n      \"processUs\": ";
+        writeHistogram(os, s.process);
+        os << ",\n      \"waitInputUs\": ";
+        writeHistogram(os, s.waitInput);
+        os << ",\n      \"waitOutputUs\": ";
+        writeHistogram(os, s.waitOutput);
+        os << "}" << (i + 1 < snap.stages.size() ? "," : "") << "\n";
+    }
+    os << "  },\n";
+    os << "  \"queues\": {";
+    for (size_t i = 0; i < snap.pipes.size(); i++) {
+        const auto& p = snap.pipes[i];
+        os << (i ? ", " : "") << "\"" << pipeName(static_cast<Pipe>(i))
+            << "\": {\"mean\": " << p.mean << ", \"max\": " << p.max
+            << ", \"capacity\": " << p.capacity << "}";
+    }
+    os << "},\n";
+    os << "  \"busBytes\": " << snap.bytesBus << ",\n";
+    os << "  \"busTimeMs\": " << snap.busTimeNs / 1000000.0 << ",\n";
+    os << "  \"fpsBusLimit\": " << snap.fpsBusLimit() << ",\n";
+    os << "  \"latencyGlassUs\": ";
+    writeHistogram(os, snap.latencyGlass);
+    os << ",\n";
+    os << "  \"seekMode\": \""
+        << (options.seekMode == SeekMode::Fast ? "fast" : "accurate") << "\",\n";
+    os << "  \"latencySeekUs\": ";
+    writeHistogram(os, snap.latencySeek);
+    os << ",\n";
+    os << "  \"allocations\": " << allocations << ",\n";
+    os << "  \"allocationsPerFrame\": "
+        << (snap.framesDisplayed ? static_cast<double>(allocations) / snap.framesDisplayed : 0.0)
+        << "\n";
+    os << "}" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            printUsage();
+            return 0;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[Bench] " << e.what() << std::endl;
+        printUsage();
+        return -1;
+    }
+
+    // The pipeline logs to std::cout; stdout carries the JSON report alone
+    std::ostream report(std::cout.rdbuf());
+    RedirectStream logs(std::cout, std::cerr);
+
+    if (options.checkKernel) {
+        KernelCheck check;
+        bool pass = check.run();
+        if (options.output.empty()) {
+            check.writeJson(report);
+        } else {
+            std::ofstream file(options.output);
+            check.writeJson(file);
+        }
+        return pass ? 0 : 1;
+    }
+
+    std::string source = resolveInput(options);
+    bool encoded = false;
+    if (!options.encoder.empty()) {
+        std::string clip = options.clip.empty()
+            ? "/tmp/bplayer-bench-" + std::to_string(getpid()) + ".mkv" : options.clip;
+        ClipEncoder encoder;
+        if (!encoder.encode(source, options.encoder, clip)) {
+            std::cerr << "[Bench] Failed to encode the test clip" << std::endl;
+            return -1;
+        }
+        source = clip;
+        encoded = true;
+    }
+
+    int ret = 0;
+    {
+        PlayerCore player;
+        PlayerConfig& config = player.getConfig();
+        config.displayType = options.displayType;
+        config.pixFmtNull = options.pixFmt;
+        config.enablePacing = options.realtime;
+        config.renderKernel = options.renderKernel;
+        config.ditherMono = options.ditherMono;
+        config.countThreadsScaler = options.threadsScaler;
+        config.countWorkersRenderer = options.workersRenderer;
+        config.threadingDecode = options.threadingDecode;
+        config.countThreadsDecode = options.threadsDecode;
+        config.lowDelayDecode = options.lowDelay;
+        config.indexStreamVideo = options.indexStreamVideo;
+        config.readerInput = options.reader;
+        config.sizeBufferIo = options.sizeBufferIo;
+        config.sizeRingReadAhead = options.sizeRingReadAhead;
+        config.probeCache = options.probeCache;
+        // Flat out, the virtual bus only accounts its wire time
+        config.realtimeVirtualBus = options.realtime;
+        config.clockVirtualBusHz = options.clockBusHz;
+        const int64_t initBegin = Timer::nowUs();
+        const bool initialized = player.init(source, options.orientation, 
+            options.width, options.height, -1, -1);
+        const int64_t initUs = Timer::nowUs() - initBegin;
+        if (!initialized) {
+            std::cerr << "[Bench] Failed to initialize the player" << std::endl;
+            ret = -1;
+        } else {
+            uint64_t allocBegin = countAllocations();
+            int64_t begin = Timer::nowUs();
+            std::thread threadSeek;
+            if (options.seekAtS >= 0.0) {
+                threadSeek = std::thread([&player, &options]() {
+                    std::this_thread::sleep_for(std::chrono::microseconds(
+                        static_cast<int64_t>(options.seekAtS * 1e6)));
+                    if (!player.seek(static_cast<int64_t>(options.seekToS * 1e6),
+                            options.seekMode)) {
+                        std::cerr << "[Bench] Playback ended before the seek" << std::endl;
+                    }
+                });
+            }
+            player.play();
+            int64_t wallUs = Timer::nowUs() - begin;
+            if (threadSeek.joinable()) {
+                threadSeek.join();
+            }
+            uint64_t allocations = countAllocations() - allocBegin;
+            TelemetrySnapshot snap = player.getTelemetry();
+
+            if (options.output.empty()) {
+                writeReport(report, options, source, snap, allocations, initUs, wallUs);
+            } else {
+                std::ofstream file(options.output);
+                writeReport(file, options, source, snap, allocations, initUs, wallUs);
+                if (!file) {
+                    std::cerr << "[Bench] Failed to write " << options.output << std::endl;
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (encoded && !options.keepClip) {
+        std::remove(source.c_str());
+    }
+    return ret;
+}
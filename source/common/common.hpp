@@ -16,3 +16,4 @@
 #include <bitset>
 
 #include "BlockingQueue.hpp"
+#include "PipeQueue.hpp"
@@ -2,6 +2,7 @@
 
 extern "C" {
 #include <libavformat/avformat.h>
+#include <libavdevice/avdevice.h>
 #include <libavcodec/avcodec.h>
 #include <libswscale/swscale.h>
 #include <libavutil/imgutils.h>
@@ -39,20 +40,200 @@ inline std::shared_ptr<AVPacket> make_avpacket() {
 	return std::shared_ptr<AVPacket>(av_packet_alloc(), deleter);
 }
 
+// Seek marker, queued like the nullptr end of stream: a stage taking it
+// drops what it still holds from before the seek and passes it on. It
+// carries the serial of its seek (PlayerState::serialSeek) in pts.
+inline std::shared_ptr<AVPacket> make_avpacket_flush(uint64_t serial) {
+    auto packet = make_avpacket();
+    // No stream has a negative index
+    packet->stream_index = -1;
+    packet->pts = static_cast<int64_t>(serial);
+    return packet;
+}
+
+inline std::shared_ptr<AVFrame> make_avframe_flush(uint64_t serial) {
+    auto frame = make_avframe();
+    // Decoded and rendered pictures always have a format
+    frame->format = -1;
+    frame->pts = static_cast<int64_t>(serial);
+    return frame;
+}
+
+inline bool is_flush(const AVPacket* packet) {
+    return packet && packet->stream_index < 0;
+}
+
+inline bool is_flush(const AVFrame* frame) {
+    return frame && frame->format < 0;
+}
+
+template<typename T>
+uint64_t serial_flush(const T* marker) {
+    return static_cast<uint64_t>(marker->pts);
+}
+
+// Panel driver created by DisplayerVideo
+enum class DisplayType : int {
+    SSD1306,
+    ST7735S,
+    // No hardware, frames are accounted and discarded (benchmarks)
+    Null,
+    // Real driver logic against an emulated panel and bus
+    ST7735SVirtual,
+    SSD1306Virtual
+};
+
+// Scale/convert implementation of the renderer
+enum class RenderKernel : int {
+    Swscale,
+    // Fused box scale + YUV->RGB + ordered dither for 4:2:0 -> RGB565BE,
+    // luma only box scale + dither into the pages of monochrome panels;
+    // swscale is used for any other conversion
+    Native
+};
+
+// Dither of the native monochrome renderer
+enum class DitherMono : int {
+    Threshold,
+    // 8x8 ordered
+    Bayer,
+    FloydSteinberg,
+    // Diffuses 3/4 of the error, keeps more contrast on small panels
+    Atkinson
+};
+
+// Threading of the software decoder
+enum class ThreadingDecode : int {
+    // Frame threading unless low delay is wanted or its extra pictures do
+    // not fit in memory, slice threading then
+    Auto,
+    // One frame per thread: most throughput, but (threads - 1) frames of
+    // delay and a picture set per thread
+    Frame,
+    // Threads share one frame, no delay; only streams with slices gain
+    Slice,
+    Off
+};
+
+// Low delay decoding: AV_CODEC_FLAG_LOW_DELAY and no frame threading
+enum class LowDelay : int {
+    // For live inputs only, see PlayerState::liveInput
+    Auto,
+    Off,
+    On
+};
+
+// Byte source of local files
+enum class ReaderInput : int {
+    // libavformat's file protocol
+    Default,
+    // Custom AVIOContext over a mapping of the file, see ReaderMmap
+    Mmap,
+    // Several reads in flight through io_uring, see ReaderUring; the file
+    // protocol when the kernel does not offer it
+    Uring
+};
+
+// Reuse of earlier stream probes of local files, see ProbeCache
+enum class ProbeCacheMode : int {
+    Off,
+    // Cached parameters plus a short avformat_find_stream_info()
+    Limit,
+    // Cached parameters only, decoding starts right after the header
+    Skip
+};
+
+enum class SeekMode : int {
+    // Show the keyframe at or before the target right away
+    Fast,
+    // Decode from that keyframe, show the frame at the target
+    Accurate
+};
+
 struct PlayerState {
     std::atomic<bool> running{false};
     std::atomic<bool> paused{false};
+    // From a seek request until its first frame is on the panel
     std::atomic<bool> seeking{false};
     std::atomic<double> speed{1.0};
     std::atomic<bool> eof{false};
+    // Set in serialSeek by the displayer when it ends the playback, later
+    // seek requests fail
+    static constexpr uint64_t SERIAL_SEEK_CLOSED = 1ull << 63;
+    // Last seek request, see PlayerCore::seek(); each stage drops its
+    // items until the marker of serialSeek has passed it
     std::atomic<int64_t> seekTargetUs{-1};
+    std::atomic<SeekMode> seekMode{SeekMode::Accurate};
+    std::atomic<int64_t> seekRequestUs{0};
+    std::atomic<uint64_t> serialSeek{0};
 	std::atomic<bool> changedFrame{false};
+    // Input without a known end (capture device, network stream), set by
+    // the demuxer
+    std::atomic<bool> liveInput{false};
+    // Displayer feedback: lateness of the last shown frame against the
+    // clock (us, negative = early) and smoothed cost of one panel update
+    std::atomic<int64_t> lagDisplayUs{0};
+    std::atomic<int64_t> costDisplayUs{0};
 };
 
 struct PlayerConfig {
 	std::atomic<SwsFlags> flagsScaler = SWS_BICUBIC;
     // Dithering algorithm: SWS_DITHER_BAYER / SWS_DITHER_ED
     std::atomic<SwsDither> flagsDither = SWS_DITHER_BAYER;
+    // Frames later than this against the presentation clock are dropped
+    std::atomic<int64_t> thresholdDropLateUs{20000};
+    // Reduce decode quality (lowres, skip loop filter / IDCT) according to
+    // the downscale ratio towards the display area
+    std::atomic<bool> enableDecodePolicy{true};
+    // Let the decoder skip/drop frames the panel would not show in time
+    std::atomic<bool> enableAdaptiveDrop{true};
+    // Print a telemetry snapshot this often while playing, 0 = never
+    std::atomic<int> intervalTelemetryMs{0};
+    std::atomic<DisplayType> displayType{DisplayType::SSD1306};
+    // Native format of the null displayer, RGB565BE (TFT) or MONOBLACK (OLED)
+    std::atomic<AVPixelFormat> pixFmtNull{AV_PIX_FMT_RGB565BE};
+    // Present frames at their pts; off = as fast as the pipeline runs
+    std::atomic<bool> enablePacing{true};
+    // Virtual panels: bus clock (0 = the driver's), and whether transfers
+    // take their modelled wire time or return immediately
+    std::atomic<uint32_t> clockVirtualBusHz{0};
+    std::atomic<bool> realtimeVirtualBus{true};
+    // Largest SPI message in bytes, 0 = the spidev "bufsiz" limit
+    std::atomic<uint32_t> maxTransferSpi{0};
+    // Transfer buffers of the panel driver; from 2 on a transmit thread
+    // puts frame N on the bus while frame N+1 is packed
+    std::atomic<int> countBuffersTransmit{2};
+    std::atomic<RenderKernel> renderKernel{RenderKernel::Native};
+    std::atomic<DitherMono> ditherMono{DitherMono::FloydSteinberg};
+    // Stripes of one frame scaled concurrently (swscale slice threads,
+    // native RGB565 kernel), 0 = one per core up to 4, 1 = off; error
+    // diffusion and the mono kernel always run on one thread
+    std::atomic<int> countThreadsScaler{0};
+    // Renderer threads converting whole frames, delivered in input order;
+    // pays off for small, fast frames where slicing has too little work
+    std::atomic<int> countWorkersRenderer{1};
+    std::atomic<ThreadingDecode> threadingDecode{ThreadingDecode::Auto};
+    // Decoder threads, 0 = the cores the render workers leave free
+    std::atomic<int> countThreadsDecode{0};
+    std::atomic<LowDelay> lowDelayDecode{LowDelay::Auto};
+    // Video stream to play, -1 = the cheapest one that fills the panel
+    std::atomic<int> indexStreamVideo{-1};
+    // Read at open time by the Loader; network, device and lavfi inputs
+    // always take the libavformat protocols
+    std::atomic<ReaderInput> readerInput{ReaderInput::Default};
+    // Buffer of the custom AVIOContext, the demuxer reads this much at once
+    std::atomic<int> sizeBufferIo{64 * 1024};
+    // Window ahead of the read position the kernel is asked to fetch
+    std::atomic<int64_t> sizeReadAhead{2 * 1024 * 1024};
+    // Ring a thread keeps filled ahead of the demuxer from local files
+    // (mapped or read), 0 = off; stalls of the storage then hit that
+    // thread instead of the demuxer
+    std::atomic<int64_t> sizeRingReadAhead{0};
+    // io_uring reader: reads kept in flight and the size of each; it keeps
+    // its own queue, the read-ahead ring is not put in front of it
+    std::atomic<int> countReadsUring{8};
+    std::atomic<int> sizeBlockUring{128 * 1024};
+    std::atomic<ProbeCacheMode> probeCache{ProbeCacheMode::Off};
 };
 
 struct FrameParameter {
@@ -69,6 +250,16 @@ struct FrameParameter {
         sar_num.store(sar.num);
         sar_den.store(sar.den);
     }
+
+    std::atomic<int> timeBase_num{1};
+    std::atomic<int> timeBase_den{AV_TIME_BASE};
+    AVRational getTimeBase() const {
+        return AVRational{timeBase_num.load(), timeBase_den.load()};
+    }
+    void setTimeBase(AVRational timeBase) {
+        timeBase_num.store(timeBase.num);
+        timeBase_den.store(timeBase.den);
+    }
 };
 
 enum class Orientation : int {
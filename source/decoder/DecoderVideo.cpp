@@ -1,20 +1,28 @@
 #include "DecoderVideo.hpp"
 
+#include <unistd.h>
+
 namespace bplayer
 {
 
-DecoderVideo::DecoderVideo(BlockingQueue<std::shared_ptr<AVPacket>>& queuePacket, 
-    BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+DecoderVideo::DecoderVideo(PipeQueue<std::shared_ptr<AVPacket>>& queuePacket, 
+    PipeQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+    Timer& timer,
     AVStream*& stream,
     PlayerState& state, 
     PlayerConfig& config, 
-    FrameParameter& frameParSrc)
+    Telemetry& telemetry,
+    FrameParameter& frameParSrc, 
+    FrameParameter& frameParDst)
     : queuePacket_(queuePacket), 
         queueFrame_(queueFrame), 
+        timer_(timer),
         stream_(stream), 
         state_(state), 
         config_(config),
-        frameParSrc_(frameParSrc)
+        telemetry_(telemetry),
+        frameParSrc_(frameParSrc),
+        frameParDst_(frameParDst)
 {
 
 }
@@ -30,12 +38,19 @@ bool DecoderVideo::init()
         std::cerr << "[Decoder] AVStream is null" << std::endl;
         return false;
     }
+    return syncFrameParStream();
+}
+
+bool DecoderVideo::open()
+{
     bool ret = openCodecVideo() && syncFramePar();
     return ret;
 }
 
 void DecoderVideo::run()
 {
+    // A nullptr packet marks the end of stream, it is sent to the codec as
+    // is to drain the delayed frames
     // Lambda for checking the pts of a frame
     // If the frame doesn't contain a pts, pass the one of packet
     auto resolve_pts = [](const AVFrame* frame, const AVPacket* pkt) -> int64_t {
@@ -48,15 +63,39 @@ void DecoderVideo::run()
         return AV_NOPTS_VALUE;
     };
 
+    resetAdaptiveDrop();
+    countDropped_ = 0;
+    StageMetrics& metrics = telemetry_.stage(Stage::DecoderVideo);
+    GaugeQueue& gauge = telemetry_.pipe(Pipe::PacketVideo);
     while (state_.running.load()) {
-        auto packet = make_avpacket();
-        queuePacket_.pop(packet);
+        std::shared_ptr<AVPacket> packet;
+        int64_t begin = Timer::nowUs();
+        if (!queuePacket_.popFor(packet, std::chrono::milliseconds(100))) {
+            continue;
+        }
+        int64_t popped = Timer::nowUs();
+        metrics.waitInput.record(popped - begin);
+        gauge.sample(queuePacket_.size(), queuePacket_.capacity());
+        if (is_flush(packet.get())) {
+            flushForSeek(serial_flush(packet.get()));
+            continue;
+        }
+        // Left over from before a seek whose marker is still on the way;
+        // the end of stream always gets through
+        if (packet && serialSeek_ != state_.serialSeek.load()) {
+            continue;
+        }
+        int64_t blockedUs = 0;
 
         int ret = avcodec_send_packet(ctxCodec_, packet.get());
         if (ret < 0) {
             char errBuf[256];
 			av_strerror(ret, errBuf, sizeof(errBuf));
 			std::cerr << "[Decoder] Failed to send packet: " << errBuf << std::endl;
+            if (!packet) {
+                // The end of stream still has to reach the displayer
+                queueFrame_.push(nullptr);
+            }
 			continue;
         }
 
@@ -73,23 +112,32 @@ void DecoderVideo::run()
                 break;
             }
             frame->pts = resolve_pts(frame.get(), packet.get());
+            metrics.items.fetch_add(1, std::memory_order_relaxed);
+            if (isBeforeSeekTarget(frame.get())) {
+                continue;
+            }
+            if (!acceptFrame(frame.get())) {
+                countDropped_++;
+                metrics.dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            int64_t pushBegin = Timer::nowUs();
             queueFrame_.push(std::move(frame));
+            int64_t pushUs = Timer::nowUs() - pushBegin;
+            metrics.waitOutput.record(pushUs);
+            blockedUs += pushUs;
         }
-    }
-
-    // Flush decoder for the rest frames
-    avcodec_send_packet(ctxCodec_, nullptr);
-    int ret = 0;
-    while (ret >= 0) {
-        auto frame = make_avframe();
-        ret = avcodec_receive_frame(ctxCodec_, frame.get());
-        if (ret < 0 ) {
-            char errBuf[256];
-            av_strerror(ret, errBuf, sizeof(errBuf));
-            std::cerr << "[Decoder] Failed to flush decoder: " << errBuf << std::endl;
-            break;
+        metrics.process.record(Timer::nowUs() - popped - blockedUs);
+        metrics.sampleCpu();
+        if (!packet) {
+            // End of stream: the decoder has been drained, pass it on;
+            // a seek restarts it through flushForSeek()
+            queueFrame_.push(nullptr);
         }
-        queueFrame_.push(std::move(frame));
+    }
+    if (countDropped_ > 0) {
+        std::cout << "[Video Decoder] Dropped frames: " 
+            << countDropped_ << std::endl;
     }
 }
 
@@ -124,15 +172,19 @@ bool DecoderVideo::openCodecVideo()
             avcodec_free_context(&ctxCodec_);
             return false;
         }
+        applyDecodePolicy();
+        applyThreadingPolicy();
         if (avcodec_open2(ctxCodec_, codec_, nullptr) < 0) {
             std::cerr << "[Video Decoder] Failed to open decoder" << std::endl;
             avcodec_free_context(&ctxCodec_);
             return false;
         }
         std::cout << "[Video Decoder] Using software decoder: " << codec_->name << std::endl;
+        reportThreading(false);
         return true;
     } else {
         std::cout << "[Video Decoder] Using hardware decoder: " << codec_->name << std::endl;
+        reportThreading(true);
         return true;
     }
 }
@@ -144,13 +196,14 @@ bool DecoderVideo::openCodecVideoByName(const char* name)
         return false;
     }
     ctxCodec_ = avcodec_alloc_context3(codec_);
-    if (ctxCodec_) {
+    if (!ctxCodec_) {
         return false;
     }
     if (avcodec_parameters_to_context(ctxCodec_, stream_->codecpar) < 0) {
         avcodec_free_context(&ctxCodec_);
         return false;
     }
+    applyDecodePolicy();
     if (avcodec_open2(ctxCodec_, codec_, nullptr) < 0) {
         avcodec_free_context(&ctxCodec_);
         return false;
@@ -158,6 +211,277 @@ bool DecoderVideo::openCodecVideoByName(const char* name)
     return true;
 }
 
+// Must run before avcodec_open2() and after applyDecodePolicy(), the
+// memory estimate uses the lowres picture size
+void DecoderVideo::applyThreadingPolicy()
+{
+    const LowDelay lowDelayMode = config_.lowDelayDecode;
+    const bool lowDelay = lowDelayMode == LowDelay::On 
+        || (lowDelayMode == LowDelay::Auto && state_.liveInput);
+    if (lowDelay) {
+        ctxCodec_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    int threads = config_.countThreadsDecode;
+    if (threads <= 0) {
+        threads = countThreadsFree();
+    }
+    const bool canFrame = codec_->capabilities & AV_CODEC_CAP_FRAME_THREADS;
+    const bool canSlice = codec_->capabilities & AV_CODEC_CAP_SLICE_THREADS;
+    ThreadingDecode mode = config_.threadingDecode;
+    if (mode == ThreadingDecode::Auto) {
+        mode = fitsFrameThreads(threads) ? ThreadingDecode::Frame : ThreadingDecode::Slice;
+    }
+    // Frame threading holds frames back, which low delay rules out
+    if (mode == ThreadingDecode::Frame && (lowDelay || !canFrame)) {
+        mode = ThreadingDecode::Slice;
+    }
+    if (mode == ThreadingDecode::Slice && !canSlice) {
+        mode = ThreadingDecode::Off;
+    }
+    switch (mode) {
+    case ThreadingDecode::Frame:
+        ctxCodec_->thread_type = FF_THREAD_FRAME;
+        ctxCodec_->thread_count = threads;
+        break;
+    case ThreadingDecode::Slice:
+        ctxCodec_->thread_type = FF_THREAD_SLICE;
+        ctxCodec_->thread_count = threads;
+        break;
+    default:
+        ctxCodec_->thread_count = 1;
+        break;
+    }
+}
+
+// The render workers keep a core each; the demuxer and the displayer
+// mostly wait on I/O and the bus, slicing threads only run in bursts
+int DecoderVideo::countThreadsFree() const
+{
+    const int cores = static_cast<int>(std::thread::hardware_concurrency());
+    const int busy = std::max(config_.countWorkersRenderer.load(), 1);
+    return std::clamp(cores - busy, 1, MAX_THREADS_AUTO);
+}
+
+// Every frame thread keeps its own pictures alive, which matters on
+// boards with 512 MB
+bool DecoderVideo::fitsFrameThreads(int threads) const
+{
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long sizePage = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || sizePage <= 0) {
+        return true;
+    }
+    const int64_t memory = static_cast<int64_t>(pages) * sizePage;
+    const int64_t width = stream_->codecpar->width >> ctxCodec_->lowres;
+    const int64_t height = stream_->codecpar->height >> ctxCodec_->lowres;
+    // 4:2:0 at 8 bits
+    const int64_t sizePicture = width * height * 3 / 2;
+    const int64_t extra = static_cast<int64_t>(threads - 1) 
+        * PICTURES_PER_FRAME_THREAD * sizePicture;
+    return extra <= memory / FRACTION_MEMORY_FRAME_THREADS;
+}
+
+// What libavcodec actually enabled, into the log and the stage telemetry
+void DecoderVideo::reportThreading(bool hardware)
+{
+    static constexpr const char* MODES[2][3] = {
+        {"single", "slice", "frame"},
+        {"single, low delay", "slice, low delay", "frame, low delay"},
+    };
+    StageMetrics& metrics = telemetry_.stage(Stage::DecoderVideo);
+    if (hardware) {
+        metrics.threads = 1;
+        metrics.mode = "hardware";
+        return;
+    }
+    int type = 0;
+    if (ctxCodec_->active_thread_type & FF_THREAD_FRAME) {
+        type = 2;
+    } else if (ctxCodec_->active_thread_type & FF_THREAD_SLICE) {
+        type = 1;
+    }
+    const bool lowDelay = ctxCodec_->flags & AV_CODEC_FLAG_LOW_DELAY;
+    const int threads = type ? std::max(ctxCodec_->thread_count, 1) : 1;
+    metrics.threads = threads;
+    metrics.mode = MODES[lowDelay][type];
+    std::cout << "[Video Decoder] Threading: " << MODES[lowDelay][type] << ", " 
+        << threads << " threads" << std::endl;
+}
+
+// Decode only as much detail as the display area can show
+// Must run before avcodec_open2(), lowres is fixed once the codec is open.
+void DecoderVideo::applyDecodePolicy()
+{
+    int srcW = stream_->codecpar->width;
+    int srcH = stream_->codecpar->height;
+    int dstW = frameParDst_.width;
+    int dstH = frameParDst_.height;
+    if (!config_.enableDecodePolicy || srcW <= 0 || srcH <= 0 
+        || dstW <= 0 || dstH <= 0) {
+        return;
+    }
+    // Downscale ratio of the renderer, the smaller axis decides
+    double ratio = std::min(static_cast<double>(srcW) / dstW, 
+        static_cast<double>(srcH) / dstH);
+
+    // Largest power of two that still leaves at least the display area
+    int lowres = 0;
+    while (lowres < codec_->max_lowres 
+        && (srcW >> (lowres + 1)) >= dstW 
+        && (srcH >> (lowres + 1)) >= dstH) {
+        lowres++;
+    }
+    ctxCodec_->lowres = lowres;
+    ratio /= (1 << lowres);
+
+    // Deblocking and exact IDCT are invisible after a large downscale;
+    // reference frames are kept intact longest to avoid error drift
+    ctxCodec_->skip_loop_filter = AVDISCARD_DEFAULT;
+    ctxCodec_->skip_idct = AVDISCARD_DEFAULT;
+    if (ratio >= 4.0) {
+        ctxCodec_->skip_loop_filter = AVDISCARD_ALL;
+        ctxCodec_->flags2 |= AV_CODEC_FLAG2_FAST;
+    } else if (ratio >= 2.0) {
+        ctxCodec_->skip_loop_filter = AVDISCARD_NONREF;
+    }
+    if (ratio >= 16.0) {
+        ctxCodec_->skip_idct = AVDISCARD_BIDIR;
+    } else if (ratio >= 8.0) {
+        ctxCodec_->skip_idct = AVDISCARD_NONREF;
+    }
+    // Dropping whole frames changes the frame rate, not the picture size
+    ctxCodec_->skip_frame = AVDISCARD_DEFAULT;
+
+    std::cout << "[Video Decoder] Decode policy: lowres " << lowres 
+        << ", remaining downscale " << ratio 
+        << ", skip_loop_filter " << ctxCodec_->skip_loop_filter 
+        << ", skip_idct " << ctxCodec_->skip_idct << std::endl;
+}
+
+void DecoderVideo::resetAdaptiveDrop()
+{
+    levelSkip_ = AVDISCARD_DEFAULT;
+    countLate_ = 0;
+    countEarly_ = 0;
+    ptsDueUs_ = AV_NOPTS_VALUE;
+    if (ctxCodec_) {
+        ctxCodec_->skip_frame = levelSkip_;
+    }
+}
+
+// Drops the pictures and references of the old position, the next
+// packet is the keyframe the demuxer landed on
+void DecoderVideo::flushForSeek(uint64_t serial)
+{
+    avcodec_flush_buffers(ctxCodec_);
+    resetAdaptiveDrop();
+    serialSeek_ = serial;
+    discardBeforeUs_ = AV_NOPTS_VALUE;
+    if (serial == state_.serialSeek.load() && state_.seekMode == SeekMode::Accurate) {
+        discardBeforeUs_ = state_.seekTargetUs;
+    }
+    queueFrame_.push(make_avframe_flush(serial));
+}
+
+// Accurate seek: the frames between the keyframe and the target are only
+// decoded as references; the one showing at the target stays
+bool DecoderVideo::isBeforeSeekTarget(const AVFrame* frame)
+{
+    if (discardBeforeUs_ == AV_NOPTS_VALUE || frame->pts == AV_NOPTS_VALUE) {
+        return false;
+    }
+    const int64_t ptsUs = av_rescale_q(frame->pts, stream_->time_base, AV_TIME_BASE_Q);
+    const double rate = av_q2d(stream_->avg_frame_rate);
+    const int64_t durationUs = rate > 0.0 ? static_cast<int64_t>(1e6 / rate) : 1;
+    if (ptsUs + durationUs <= discardBeforeUs_) {
+        return true;
+    }
+    discardBeforeUs_ = AV_NOPTS_VALUE;
+    return false;
+}
+
+// Decide whether a decoded frame is worth rendering
+// Frames already behind the clock would be dropped by the displayer anyway,
+// and frames closer together than one panel update can never be shown.
+bool DecoderVideo::acceptFrame(const AVFrame* frame)
+{
+    // Until the first frame after a seek is shown the clock still runs
+    // for the old position
+    if (!config_.enableAdaptiveDrop || frame->pts == AV_NOPTS_VALUE 
+        || !timer_.isStarted() || timer_.isPaused() || state_.seeking) {
+        return true;
+    }
+    int64_t ptsUs = av_rescale_q(frame->pts, stream_->time_base, AV_TIME_BASE_Q);
+    int64_t lateUs = timer_.getTimeUs() - ptsUs;
+    adaptSkipLevel(std::max(lateUs, state_.lagDisplayUs.load()));
+
+    // Far behind means a stall or a jump, the displayer re-anchors the
+    // clock on such a frame, so it has to get through
+    if (lateUs > config_.thresholdDropLateUs 
+        && lateUs <= Timer::THRESHOLD_RESYNC_US) {
+        return false;
+    }
+
+    // Decimate to the rate the panel achieves, spread evenly over time
+    int64_t intervalUs = static_cast<int64_t>(
+        state_.costDisplayUs.load() * state_.speed.load());
+    if (intervalUs <= 0) {
+        return true;
+    }
+    if (ptsDueUs_ == AV_NOPTS_VALUE || ptsUs < ptsDueUs_ - Timer::THRESHOLD_RESYNC_US 
+        || ptsUs - ptsDueUs_ > intervalUs) {
+        // First frame, backwards jump, or fell behind the grid
+        ptsDueUs_ = ptsUs;
+    }
+    if (ptsUs < ptsDueUs_) {
+        return false;
+    }
+    ptsDueUs_ += intervalUs;
+    return true;
+}
+
+// Raise skip_frame while decoding falls behind, lower it once well ahead
+// DEFAULT -> NONREF -> NONKEY, the codec applies it from the next packet
+void DecoderVideo::adaptSkipLevel(int64_t lateUs)
+{
+    if (lateUs > config_.thresholdDropLateUs) {
+        countEarly_ = 0;
+        if (++countLate_ < COUNT_ESCALATE || levelSkip_ == AVDISCARD_NONKEY) {
+            return;
+        }
+        levelSkip_ = levelSkip_ == AVDISCARD_DEFAULT ? AVDISCARD_NONREF : AVDISCARD_NONKEY;
+    } else if (-lateUs > THRESHOLD_EARLY_US) {
+        countLate_ = 0;
+        if (++countEarly_ < COUNT_RELAX || levelSkip_ == AVDISCARD_DEFAULT) {
+            return;
+        }
+        levelSkip_ = levelSkip_ == AVDISCARD_NONKEY ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    } else {
+        countLate_ = 0;
+        countEarly_ = 0;
+        return;
+    }
+    countLate_ = 0;
+    countEarly_ = 0;
+    ctxCodec_->skip_frame = levelSkip_;
+    std::cout << "[Video Decoder] skip_frame -> " << levelSkip_ << std::endl;
+}
+
+bool DecoderVideo::syncFrameParStream()
+{
+    AVCodecParameters* codecPar = stream_->codecpar;
+    if (codecPar->width <= 0 || codecPar->height <= 0) {
+        std::cerr << "[Video Decoder] Unknown picture size" << std::endl;
+        return false;
+    }
+    frameParSrc_.pixFmt = static_cast<AVPixelFormat>(codecPar->format);
+    frameParSrc_.width = codecPar->width;
+    frameParSrc_.height = codecPar->height;
+    frameParSrc_.setTimeBase(stream_->time_base);
+    return true;
+}
+
+// Parameters of the decoded pictures, lowres changes the size
 bool DecoderVideo::syncFramePar()
 {
     if (!ctxCodec_) {
@@ -166,6 +490,7 @@ bool DecoderVideo::syncFramePar()
     frameParSrc_.pixFmt = ctxCodec_->pix_fmt;
     frameParSrc_.width = ctxCodec_->width;
     frameParSrc_.height = ctxCodec_->height;
+    frameParSrc_.setTimeBase(stream_->time_base);
     return true;
 }
     
@@ -3,38 +3,84 @@
 #include "common.hpp"
 #include "ffmpeg.hpp"
 
+#include "Timer.hpp"
+#include "Telemetry.hpp"
+
 namespace bplayer
 {
 
 class DecoderVideo {
 public:
-    DecoderVideo(BlockingQueue<std::shared_ptr<AVPacket>>& queuePacket, 
-        BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+    DecoderVideo(PipeQueue<std::shared_ptr<AVPacket>>& queuePacket, 
+        PipeQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+        Timer& timer,
         AVStream*& stream,
         PlayerState& state, 
         PlayerConfig& config, 
-        FrameParameter& frameParSrc);
+        Telemetry& telemetry,
+        FrameParameter& frameParSrc, 
+        FrameParameter& frameParDst);
     ~DecoderVideo();
 
+    // Publishes the stream's picture parameters
     bool init();
+    // Opens the codec, needs the display area in frameParDst_
+    bool open();
     void run();
 
 private:
+    // Consecutive late frames before skipping more, early ones before less
+    static constexpr int COUNT_ESCALATE = 3;
+    static constexpr int COUNT_RELAX = 30;
+    // A frame this far ahead of the clock counts as "early"
+    static constexpr int64_t THRESHOLD_EARLY_US = 100000;
+    // Automatic decoder threads never exceed this
+    static constexpr int MAX_THREADS_AUTO = 8;
+    // Frame threading may spend this share of the RAM (1/8) on the
+    // pictures each thread keeps: its output and one reference copy
+    static constexpr int FRACTION_MEMORY_FRAME_THREADS = 8;
+    static constexpr int PICTURES_PER_FRAME_THREAD = 2;
+
     AVStream*& stream_;
     const AVCodec* codec_ = nullptr;
     AVCodecContext* ctxCodec_ = nullptr;
 
-    BlockingQueue<std::shared_ptr<AVPacket>>& queuePacket_;
-    BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame_;
+    PipeQueue<std::shared_ptr<AVPacket>>& queuePacket_;
+    PipeQueue<std::shared_ptr<AVFrame>>& queueFrame_;
+    Timer& timer_;
     
     PlayerState& state_;
     PlayerConfig& config_;
+    Telemetry& telemetry_;
 
     FrameParameter& frameParSrc_;
+    FrameParameter& frameParDst_;
+
+    // Adaptive drop state, decoder thread only
+    AVDiscard levelSkip_ = AVDISCARD_DEFAULT;
+    int countLate_ = 0;
+    int countEarly_ = 0;
+    int64_t ptsDueUs_ = AV_NOPTS_VALUE;
+    uint64_t countDropped_ = 0;
+    // Seek state, decoder thread only: serial of the last marker and the
+    // media time before which frames are decoded but not passed on
+    uint64_t serialSeek_ = 0;
+    int64_t discardBeforeUs_ = AV_NOPTS_VALUE;
 
     bool openCodecVideo();
     bool openCodecVideoByName(const char* name);
+    void applyDecodePolicy();
+    void applyThreadingPolicy();
+    int countThreadsFree() const;
+    bool fitsFrameThreads(int threads) const;
+    void reportThreading(bool hardware);
+    bool acceptFrame(const AVFrame* frame);
+    void adaptSkipLevel(int64_t lateUs);
+    void resetAdaptiveDrop();
+    void flushForSeek(uint64_t serial);
+    bool isBeforeSeekTarget(const AVFrame* frame);
 
+    bool syncFrameParStream();
     bool syncFramePar();
 };
 
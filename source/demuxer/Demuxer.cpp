@@ -1,22 +1,28 @@
 #include "Demuxer.hpp"
 
+#include "Timer.hpp"
+
 namespace bplayer
 {
 
-Demuxer::Demuxer(BlockingQueue<std::shared_ptr<AVPacket>>& queuePacketVideo, 
-    BlockingQueue<std::shared_ptr<AVPacket>>& queuePacketAudio,
+Demuxer::Demuxer(PipeQueue<std::shared_ptr<AVPacket>>& queuePacketVideo, 
+    PipeQueue<std::shared_ptr<AVPacket>>& queuePacketAudio,
     AVFormatContext*& ctxFormat, 
     AVStream*& streamVideo,
     AVStream*& streamAudio,
     PlayerState& state, 
-    PlayerConfig& config)
+    PlayerConfig& config,
+    Telemetry& telemetry,
+    ProbeCache& probeCache)
 	: queuePacketVideo_(queuePacketVideo),
 		queuePacketAudio_(queuePacketAudio),
         ctxFormat_(ctxFormat), 
         streamVideo_(streamVideo), 
         streamAudio_(streamAudio),
 		state_(state),
-        config_(config)
+        config_(config),
+        telemetry_(telemetry),
+        probeCache_(probeCache)
 {
 
 }
@@ -33,7 +39,10 @@ void Demuxer::calculateStreamScore()
     }
     AVStream* streamToCheck;
     AVCodecParameters* codecParToCheck;
-    int scoreBestVideo = -1;
+    bool coversBestVideo = false;
+    double costBestVideo = 0.0;
+    int64_t pixelsBestVideo = 0;
+    bool defaultBestVideo = false;
     int scoreBestAudio = -1;
     int scoreBestSubtitle = -1;
     for (unsigned int i=0; i < ctxFormat_->nb_streams; i++ ) {
@@ -41,13 +50,35 @@ void Demuxer::calculateStreamScore()
         codecParToCheck = streamToCheck->codecpar;
 
         if (codecParToCheck->codec_type == AVMEDIA_TYPE_VIDEO) {
-            int score = 0;
-            if (streamToCheck->disposition & AV_DISPOSITION_DEFAULT) {
-                score += 100;
+            // Cover art is a single picture, not something to play
+            if ((streamToCheck->disposition & AV_DISPOSITION_ATTACHED_PIC)
+                || codecParToCheck->width <= 0 || codecParToCheck->height <= 0) {
+                continue;
             }
-            score += codecParToCheck->width * codecParToCheck->height / 100;
-            if (score > scoreBestVideo) {
-                scoreBestVideo = score;
+            // Proxies first: the cheapest stream that covers the target,
+            // else the one coming closest; "default" only breaks ties
+            const bool covers = coversTarget(codecParToCheck);
+            const double cost = costDecode(streamToCheck);
+            const int64_t pixels = static_cast<int64_t>(codecParToCheck->width) 
+                * codecParToCheck->height;
+            const bool isDefault = streamToCheck->disposition & AV_DISPOSITION_DEFAULT;
+            bool better = false;
+            if (indexStreamVideoBest == -1) {
+                better = true;
+            } else if (covers != coversBestVideo) {
+                better = covers;
+            } else if (covers && cost != costBestVideo) {
+                better = cost < costBestVideo;
+            } else if (!covers && pixels != pixelsBestVideo) {
+                better = pixels > pixelsBestVideo;
+            } else {
+                better = isDefault && !defaultBestVideo;
+            }
+            if (better) {
+                coversBestVideo = covers;
+                costBestVideo = cost;
+                pixelsBestVideo = pixels;
+                defaultBestVideo = isDefault;
                 indexStreamVideoBest = i;
             }
         } else if (codecParToCheck->codec_type == AVMEDIA_TYPE_AUDIO) {
@@ -73,6 +104,120 @@ void Demuxer::calculateStreamScore()
     }
 }
 
+// Rough cost of the software decoders per pixel at the same frame rate
+double Demuxer::costCodec(AVCodecID id)
+{
+    switch (id) {
+    case AV_CODEC_ID_RAWVIDEO:
+        return 0.1;
+    case AV_CODEC_ID_MPEG1VIDEO:
+    case AV_CODEC_ID_MPEG2VIDEO:
+    case AV_CODEC_ID_H263:
+        return 0.5;
+    case AV_CODEC_ID_MPEG4:
+        return 0.6;
+    case AV_CODEC_ID_MJPEG:
+        return 0.7;
+    case AV_CODEC_ID_VP8:
+        return 0.9;
+    case AV_CODEC_ID_VP9:
+        return 1.3;
+    case AV_CODEC_ID_HEVC:
+        return 1.6;
+    case AV_CODEC_ID_AV1:
+        return 2.0;
+    case AV_CODEC_ID_H264:
+    default:
+        return 1.0;
+    }
+}
+
+double Demuxer::costDecode(const AVStream* stream)
+{
+    const AVCodecParameters* par = stream->codecpar;
+    double rate = av_q2d(stream->avg_frame_rate);
+    if (!(rate > 0.0)) {
+        rate = RATE_DEFAULT;
+    }
+    return static_cast<double>(par->width) * par->height * rate * costCodec(par->codec_id)
+        + static_cast<double>(std::max<int64_t>(par->bit_rate, 0)) * WEIGHT_BIT;
+}
+
+// The renderer keeps the aspect ratio: the picture fills the largest
+// area of its shape inside the target, the stream must be at least that
+bool Demuxer::coversTarget(const AVCodecParameters* par) const
+{
+    if (widthTarget_ <= 0 || heightTarget_ <= 0) {
+        return false;
+    }
+    const double scale = std::min(static_cast<double>(widthTarget_) / par->width,
+        static_cast<double>(heightTarget_) / par->height);
+    return scale <= 1.0;
+}
+
+bool Demuxer::isStreamOfType(int index, AVMediaType type) const
+{
+    if (!ctxFormat_ || index < 0 || index >= static_cast<int>(ctxFormat_->nb_streams)
+        || ctxFormat_->streams[index]->codecpar->codec_type != type) {
+        std::cerr << "[Demuxer] Stream #" << index << " is not a " 
+            << av_get_media_type_string(type) << " stream" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Lands on the keyframe at or before the target and sends the flush
+// marker down; the decoder discards up to the target in accurate mode
+void Demuxer::seek(uint64_t serial)
+{
+    const int64_t targetUs = std::max<int64_t>(state_.seekTargetUs, 0);
+    KeyframeIndex::Entry keyframe{};
+    const bool indexed = keyframes_.find(targetUs, keyframe);
+    int ret;
+    if (indexStreamVideo == -1) {
+        ret = av_seek_frame(ctxFormat_, -1, targetUs, AVSEEK_FLAG_BACKWARD);
+    } else if (indexed && keyframe.pos >= 0 && ctxFormat_->iformat
+        && (ctxFormat_->iformat->flags & AVFMT_TS_DISCONT)) {
+        // Timestamps of TS like formats wrap and jump, their byte
+        // positions do not (ffplay seeks them by bytes as well)
+        ret = av_seek_frame(ctxFormat_, -1, keyframe.pos, AVSEEK_FLAG_BYTE);
+    } else {
+        const int64_t ts = av_rescale_q(indexed ? keyframe.ptsUs : targetUs, 
+            AV_TIME_BASE_Q, ctxFormat_->streams[indexStreamVideo]->time_base);
+        ret = av_seek_frame(ctxFormat_, indexStreamVideo, ts, AVSEEK_FLAG_BACKWARD);
+    }
+    if (ret < 0) {
+        std::cerr << "[Demuxer] Seek to " << targetUs / 1000 << "ms failed: " 
+            << ffmpegErrStr(ret) << std::endl;
+    } else {
+        std::cout << "[Demuxer] Seek to " << targetUs / 1000 << "ms";
+        if (indexed) {
+            std::cout << ", keyframe at " << keyframe.ptsUs / 1000 << "ms";
+        }
+        std::cout << std::endl;
+    }
+    keyframes_.breakSpan();
+    state_.eof = false;
+    queuePacketVideo_.push(make_avpacket_flush(serial));
+    // Never blocks, like the audio packets in smartPush()
+    if (indexStreamAudio != -1) {
+        queuePacketAudio_.try_push(make_avpacket_flush(serial));
+    }
+}
+
+void Demuxer::indexKeyframe(const AVPacket* packet)
+{
+    if (packet->stream_index != indexStreamVideo || !(packet->flags & AV_PKT_FLAG_KEY)) {
+        return;
+    }
+    const int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (ts == AV_NOPTS_VALUE) {
+        return;
+    }
+    keyframes_.add(av_rescale_q(ts, ctxFormat_->streams[indexStreamVideo]->time_base, 
+        AV_TIME_BASE_Q), packet->pos);
+}
+
 template<typename U>
 void Demuxer::smartPush(U&& packet) {
 	if (!packet) {
@@ -91,10 +236,10 @@ void Demuxer::smartPush(U&& packet) {
 			}
 		}
 	} else if (indexStream == indexStreamAudio) {
-		bool success = queuePacketAudio_.push(std::forward<U>(packet));
-		if (!success) {
-			std::cerr << "[Demuxer] Dropped audio packet due to full queue (pts=" << packet->pts << ")" << std::endl;
-		}
+		// Nothing consumes audio packets yet: a blocking push would stop
+		// the demuxer for good once the queue is full, so a full queue
+		// drops them
+		queuePacketAudio_.try_push(std::forward<U>(packet));
 	}
 }
 
@@ -127,6 +272,35 @@ bool Demuxer::selectStreamSubtitleBest()
     return false;
 }
 
+bool Demuxer::selectStreamVideoManual(int index)
+{
+    if (!isStreamOfType(index, AVMEDIA_TYPE_VIDEO)) {
+        return false;
+    }
+    indexStreamVideo = index;
+    streamVideo_ = ctxFormat_->streams[indexStreamVideo];
+    return true;
+}
+
+bool Demuxer::selectStreamAudioManual(int index)
+{
+    if (!isStreamOfType(index, AVMEDIA_TYPE_AUDIO)) {
+        return false;
+    }
+    indexStreamAudio = index;
+    streamAudio_ = ctxFormat_->streams[indexStreamAudio];
+    return true;
+}
+
+bool Demuxer::selectStreamSubtitleManual(int index)
+{
+    if (!isStreamOfType(index, AVMEDIA_TYPE_SUBTITLE)) {
+        return false;
+    }
+    indexStreamSubtitle = index;
+    return true;
+}
+
 bool Demuxer::selectStreamAllBest()
 {
     bool ret = selectStreamVideoBest() || selectStreamAudioBest();
@@ -134,10 +308,42 @@ bool Demuxer::selectStreamAllBest()
     return ret;
 }
 
-bool Demuxer::init()
+bool Demuxer::init(int widthTarget, int heightTarget)
 {
-    calculateStreamScore();
-    return selectStreamAllBest();
+    // Devices and network streams have no file behind them and no end
+    state_.liveInput = (ctxFormat_->iformat 
+        && (ctxFormat_->iformat->flags & AVFMT_NOFILE))
+        || ctxFormat_->duration == AV_NOPTS_VALUE;
+    widthTarget_ = widthTarget;
+    heightTarget_ = heightTarget;
+    ProbeCache::Score score;
+    if (probeCache_.getScore(widthTarget_, heightTarget_, score)) {
+        indexStreamVideoBest = score.indexVideo;
+        indexStreamAudioBest = score.indexAudio;
+        indexStreamSubtitleBest = score.indexSubtitle;
+    } else {
+        calculateStreamScore();
+        probeCache_.setScore({widthTarget_, heightTarget_, 
+            indexStreamVideoBest, indexStreamAudioBest, indexStreamSubtitleBest});
+    }
+    bool ret = selectStreamAllBest();
+    const int indexManual = config_.indexStreamVideo;
+    if (indexManual >= 0) {
+        ret = selectStreamVideoManual(indexManual) || ret;
+    }
+    keyframes_.clear();
+    if (streamVideo_ && probeCache_.getKeyframes(streamVideo_->index, keyframes_)) {
+        std::cout << "[Demuxer] " << keyframes_.size() 
+            << " keyframes from the probe cache" << std::endl;
+    }
+    if (streamVideo_) {
+        std::cout << "[Demuxer] Video stream #" << streamVideo_->index << ": "
+            << avcodec_get_name(streamVideo_->codecpar->codec_id) << " "
+            << streamVideo_->codecpar->width << "x" 
+            << streamVideo_->codecpar->height << " for a " << widthTarget_ 
+            << "x" << heightTarget_ << " target" << std::endl;
+    }
+    return ret;
 }
 
 void Demuxer::run()
@@ -157,20 +363,69 @@ void Demuxer::run()
 	// 	<< "/" << ctxFormat_->streams[indexStreamAudio]->time_base.den
 	// 	<< std::endl;
 
+	StageMetrics& metrics = telemetry_.stage(Stage::Demuxer);
+	// Only the Loader's own readers account their time in storage
+	const bool measuresIo = ctxFormat_->flags & AVFMT_FLAG_CUSTOM_IO;
+	// The sentinel is out, only a seek brings more packets
+	bool ended = false;
+	// Probe cache entry written once decoding has something to work on
+	bool savedProbe = false;
 	while (state_.running.load()) {
+		const uint64_t serial = state_.serialSeek.load();
+		if (serial != serialSeek_ && !(serial & PlayerState::SERIAL_SEEK_CLOSED)) {
+			serialSeek_ = serial;
+			seek(serial);
+			ended = false;
+		}
+		if (ended) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(SLICE_WAIT_SEEK_MS));
+			continue;
+		}
 		auto packet = make_avpacket();
+		int64_t begin = Timer::nowUs();
+		int64_t stallBegin = metrics.stallIoUs.load(std::memory_order_relaxed);
 		int ret = av_read_frame(ctxFormat_, packet.get());
+		int64_t read = Timer::nowUs();
+		if (measuresIo) {
+			int64_t stall = metrics.stallIoUs.load(std::memory_order_relaxed) - stallBegin;
+			metrics.waitInput.record(stall);
+			metrics.process.record(read - begin - stall);
+		} else {
+			metrics.process.record(read - begin);
+		}
 
 		if (ret == AVERROR_EOF) {
-			break;
+			state_.eof = true;
+			if (keyframes_.isDirty()) {
+				probeCache_.setKeyframes(indexStreamVideo, keyframes_);
+				keyframes_.markSaved();
+			}
+			probeCache_.save();
+			// End of stream sentinel, drains the stages behind us; they
+			// stay up until the displayer ends the playback
+			queuePacketVideo_.push(nullptr);
+			ended = true;
+			continue;
 		} else if (ret < 0) {
 			char errBuf[256];
 			av_strerror(ret, errBuf, sizeof(errBuf));
 			std::cerr << "[Demuxer] Failed to read frame: " << errBuf << std::endl;
-			break;
+			// Ends the playback like the end of the input; a seek may
+			// still get past the error
+			queuePacketVideo_.push(nullptr);
+			ended = true;
+			continue;
 		}
 
+		indexKeyframe(packet.get());
 		smartPush(std::move(packet));
+		metrics.waitOutput.record(Timer::nowUs() - read);
+		metrics.items.fetch_add(1, std::memory_order_relaxed);
+		if (!savedProbe) {
+			probeCache_.save();
+			savedProbe = true;
+		}
+		metrics.sampleCpu();
 	}
 }
 
@@ -3,20 +3,29 @@
 #include "common.hpp"
 #include "ffmpeg.hpp"
 
+#include "Telemetry.hpp"
+#include "ProbeCache.hpp"
+#include "KeyframeIndex.hpp"
+
 namespace bplayer {
 
 class Demuxer {
 public:
-    Demuxer(BlockingQueue<std::shared_ptr<AVPacket>>& queuePacketVideo, 
-        BlockingQueue<std::shared_ptr<AVPacket>>& queuePacketAudio,
+    Demuxer(PipeQueue<std::shared_ptr<AVPacket>>& queuePacketVideo, 
+        PipeQueue<std::shared_ptr<AVPacket>>& queuePacketAudio,
         AVFormatContext*& ctxFormat, 
         AVStream*& streamVideo,
         AVStream*& streamAudio,
         PlayerState& state,
-        PlayerConfig& config);
+        PlayerConfig& config,
+        Telemetry& telemetry,
+        ProbeCache& probeCache);
     ~Demuxer();
 
-    bool init();
+    // Video goes to the cheapest stream that still fills a display area
+    // inside widthTarget x heightTarget, the largest if none does or the
+    // target is unknown (<= 0); PlayerConfig::indexStreamVideo overrides
+    bool init(int widthTarget = -1, int heightTarget = -1);
     void run();
 
     bool selectStreamVideoBest();
@@ -24,17 +33,28 @@ public:
     bool selectStreamSubtitleBest();
     bool selectStreamAllBest();
 
-    // void selectStreamVideoManual(int index);
-    // void selectStreamAudioManual(int index);
-    // void selectStreamSubtitleManual(int index);
+    // Override the automatic choice, before the decoder is initialized
+    bool selectStreamVideoManual(int index);
+    bool selectStreamAudioManual(int index);
+    bool selectStreamSubtitleManual(int index);
 
 private:
-    BlockingQueue<std::shared_ptr<AVPacket>>& queuePacketVideo_;
-    BlockingQueue<std::shared_ptr<AVPacket>>& queuePacketAudio_;
+    // Frame rate assumed for streams that do not announce one
+    static constexpr double RATE_DEFAULT = 25.0;
+    // Decode work of one bit of entropy coding against one pixel of
+    // reconstruction
+    static constexpr double WEIGHT_BIT = 1.0;
+    // Poll for a seek request once the input has ended
+    static constexpr int SLICE_WAIT_SEEK_MS = 10;
+
+    PipeQueue<std::shared_ptr<AVPacket>>& queuePacketVideo_;
+    PipeQueue<std::shared_ptr<AVPacket>>& queuePacketAudio_;
     AVFormatContext*& ctxFormat_;
 
     PlayerState& state_;
     PlayerConfig& config_;
+    Telemetry& telemetry_;
+    ProbeCache& probeCache_;
 
     AVStream*& streamVideo_;
     AVStream*& streamAudio_;
@@ -45,8 +65,21 @@ private:
     int indexStreamVideoBest = -1;
     int indexStreamAudioBest = -1;
     int indexStreamSubtitleBest = -1;
+    int widthTarget_ = -1;
+    int heightTarget_ = -1;
+    KeyframeIndex keyframes_;
+    // Last seek carried out
+    uint64_t serialSeek_ = 0;
 
     void calculateStreamScore();
+    // Relative decode cost per pixel, H.264 = 1
+    static double costCodec(AVCodecID id);
+    // Estimated decode work per second
+    static double costDecode(const AVStream* stream);
+    bool coversTarget(const AVCodecParameters* par) const;
+    bool isStreamOfType(int index, AVMediaType type) const;
+    void seek(uint64_t serial);
+    void indexKeyframe(const AVPacket* packet);
     
     template<typename U>
     void smartPush(U&& packet);
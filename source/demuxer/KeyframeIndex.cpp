@@ -0,0 +1,110 @@
+#include "KeyframeIndex.hpp"
+
+namespace bplayer
+{
+
+KeyframeIndex::KeyframeIndex()
+{
+
+}
+
+KeyframeIndex::~KeyframeIndex()
+{
+
+}
+
+void KeyframeIndex::clear()
+{
+    entries_.clear();
+    covered_.clear();
+    lastUs_ = AV_NOPTS_VALUE;
+    dirty_ = false;
+}
+
+void KeyframeIndex::breakSpan()
+{
+    lastUs_ = AV_NOPTS_VALUE;
+}
+
+void KeyframeIndex::add(int64_t ptsUs, int64_t pos)
+{
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), ptsUs, 
+        [](const Entry& entry, int64_t value) { return entry.ptsUs < value; });
+    if (it == entries_.end() || it->ptsUs != ptsUs) {
+        entries_.insert(it, Entry{ptsUs, pos});
+        dirty_ = true;
+    }
+    // Timestamps going back are a discontinuity, not a span
+    if (lastUs_ != AV_NOPTS_VALUE && lastUs_ < ptsUs) {
+        cover(lastUs_, ptsUs);
+    }
+    lastUs_ = ptsUs;
+}
+
+bool KeyframeIndex::find(int64_t targetUs, Entry& entry) const
+{
+    // Interval starting last at or before the target
+    auto covered = covered_.upper_bound(targetUs);
+    if (covered == covered_.begin()) {
+        return false;
+    }
+    --covered;
+    if (targetUs > covered->second) {
+        return false;
+    }
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), targetUs, 
+        [](int64_t value, const Entry& entry) { return value < entry.ptsUs; });
+    if (it == entries_.begin()) {
+        return false;
+    }
+    entry = *(it - 1);
+    return true;
+}
+
+std::vector<std::pair<int64_t, int64_t>> KeyframeIndex::getCovered() const
+{
+    return std::vector<std::pair<int64_t, int64_t>>(covered_.begin(), covered_.end());
+}
+
+void KeyframeIndex::assign(std::vector<Entry> entries, 
+    const std::vector<std::pair<int64_t, int64_t>>& covered)
+{
+    clear();
+    std::sort(entries.begin(), entries.end(), 
+        [](const Entry& a, const Entry& b) { return a.ptsUs < b.ptsUs; });
+    for (const Entry& entry : entries) {
+        if (entries_.empty() || entries_.back().ptsUs != entry.ptsUs) {
+            entries_.push_back(entry);
+        }
+    }
+    for (const auto& interval : covered) {
+        if (interval.first <= interval.second) {
+            cover(interval.first, interval.second);
+        }
+    }
+    dirty_ = false;
+}
+
+// Adds [begin, end] and merges it with the intervals it touches
+void KeyframeIndex::cover(int64_t begin, int64_t end)
+{
+    auto it = covered_.upper_bound(begin);
+    if (it != covered_.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second >= begin) {
+            if (prev->second >= end) {
+                return;
+            }
+            begin = prev->first;
+            it = prev;
+        }
+    }
+    while (it != covered_.end() && it->first <= end) {
+        end = std::max(end, it->second);
+        it = covered_.erase(it);
+    }
+    covered_[begin] = end;
+    dirty_ = true;
+}
+
+}
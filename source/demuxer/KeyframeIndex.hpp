@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+#include <map>
+
+namespace bplayer
+{
+
+// Keyframes of the video stream seen while demuxing
+// Between two keyframes demuxed one after the other there is no other
+// keyframe, so every such pair marks a covered interval; a lookup only
+// answers inside covered intervals, where the keyframe found is really
+// the last one before the target. Demuxer thread only.
+class KeyframeIndex {
+public:
+    struct Entry {
+        int64_t ptsUs;
+        // Byte position in the file, -1 if the demuxer does not know it
+        int64_t pos;
+    };
+
+    KeyframeIndex();
+    ~KeyframeIndex();
+
+    void clear();
+    // The next keyframe does not follow the last one (after a seek)
+    void breakSpan();
+    void add(int64_t ptsUs, int64_t pos);
+    // Last keyframe at or before targetUs, false if not known for sure
+    bool find(int64_t targetUs, Entry& entry) const;
+
+    size_t size() const { return entries_.size(); }
+    // Changed since the last markSaved()
+    bool isDirty() const { return dirty_; }
+    void markSaved() { dirty_ = false; }
+
+    // Flat form for the probe cache
+    const std::vector<Entry>& getEntries() const { return entries_; }
+    std::vector<std::pair<int64_t, int64_t>> getCovered() const;
+    void assign(std::vector<Entry> entries, 
+        const std::vector<std::pair<int64_t, int64_t>>& covered);
+
+private:
+    // Sorted by pts, no duplicates
+    std::vector<Entry> entries_;
+    // Covered intervals [begin, end] by begin, never overlapping
+    std::map<int64_t, int64_t> covered_;
+    // Previous keyframe of the current span
+    int64_t lastUs_ = AV_NOPTS_VALUE;
+    bool dirty_ = false;
+
+    void cover(int64_t begin, int64_t end);
+};
+
+}
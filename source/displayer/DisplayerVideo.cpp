@@ -2,18 +2,25 @@
 
 #include "ST7735S.hpp"
 #include "SSD1306.hpp"
+#include "NullDisplayer.hpp"
+#include "ST7735SVirtual.hpp"
+#include "SSD1306Virtual.hpp"
 
 namespace bplayer
 {
 
-DisplayerVideo::DisplayerVideo(BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+DisplayerVideo::DisplayerVideo(PipeQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+    Timer& timer,
     PlayerState& state,
     PlayerConfig& config,
+    Telemetry& telemetry,
     FrameParameter& frameParSrc, 
     FrameParameter& frameParDst)
     : queueFrame_(queueFrame), 
+        timer_(timer),
         state_(state), 
         config_(config),
+        telemetry_(telemetry),
         frameParSrc_(frameParSrc), 
         frameParDst_(frameParDst)
 {
@@ -25,25 +32,247 @@ DisplayerVideo::~DisplayerVideo()
     
 }
 
-bool DisplayerVideo::init(Orientation orientation, 
-    int width, int height, int offsetX, int offsetY)
+bool DisplayerVideo::open(Orientation orientation)
 {
-    screen_ = std::make_unique<DisplayerSSD1306>(frameParSrc_, frameParDst_, config_);
+    switch (config_.displayType.load()) {
+    case DisplayType::ST7735S:
+        screen_ = std::make_unique<DisplayerST7735S>(frameParSrc_, frameParDst_, config_);
+        break;
+    case DisplayType::Null:
+        screen_ = std::make_unique<DisplayerNull>(frameParSrc_, frameParDst_, config_);
+        break;
+    case DisplayType::ST7735SVirtual:
+        screen_ = std::make_unique<DisplayerST7735SVirtual>(frameParSrc_, frameParDst_, config_);
+        break;
+    case DisplayType::SSD1306Virtual:
+        screen_ = std::make_unique<DisplayerSSD1306Virtual>(frameParSrc_, frameParDst_, config_);
+        break;
+    case DisplayType::SSD1306:
+    default:
+        screen_ = std::make_unique<DisplayerSSD1306>(frameParSrc_, frameParDst_, config_);
+        break;
+    }
+    screen_->setCallbackTransfer([this](const IDisplayer::Transfer& transfer) {
+        onTransfer(transfer);
+    });
     bool ret = screen_->init();
     screen_->clear();
     screen_->setOrientation(orientation);
-    screen_->setArea(width, height, offsetX, offsetY);
-    ret = ret && screen_->syncFramePar();
     return ret;
 }
 
+void DisplayerVideo::getSizeTarget(int width, int height, 
+    int& widthTarget, int& heightTarget) const
+{
+    screen_->getSizeScreen(widthTarget, heightTarget);
+    if (width > 0) {
+        widthTarget = std::min(width, widthTarget);
+    }
+    if (height > 0) {
+        heightTarget = std::min(height, heightTarget);
+    }
+}
+
+bool DisplayerVideo::setArea(int width, int height, int offsetX, int offsetY)
+{
+    screen_->setArea(width, height, offsetX, offsetY);
+    return screen_->syncFramePar();
+}
+
+IDisplayer* DisplayerVideo::getScreen()
+{
+    return screen_.get();
+}
+
 void DisplayerVideo::run()
 {
+    timer_.reset();
+    countDropped_ = 0;
+    state_.lagDisplayUs = 0;
+    state_.costDisplayUs = 0;
+    std::shared_ptr<AVFrame> frame;
+    StageMetrics& metrics = telemetry_.stage(Stage::DisplayerVideo);
+    GaugeQueue& gauge = telemetry_.pipe(Pipe::FrameDst);
+    auto waitBegin = Timer::Clock::now();
+    while (state_.running.load()) {
+        if (!queueFrame_.popFor(frame, std::chrono::milliseconds(100))) {
+            continue;
+        }
+        auto popped = Timer::Clock::now();
+        metrics.waitInput.record(elapsedUs(waitBegin, popped));
+        gauge.sample(queueFrame_.size(), queueFrame_.capacity());
+        if (!frame) {
+            // End of stream; unless a seek is on the way, close seeking
+            // for good and end the playback
+            uint64_t serial = serialSeek_;
+            if (state_.serialSeek.compare_exchange_strong(serial,
+                    serialSeek_ | PlayerState::SERIAL_SEEK_CLOSED)) {
+                state_.running = false;
+                break;
+            }
+            waitBegin = popped;
+            continue;
+        }
+        if (is_flush(frame.get())) {
+            // The clock restarts from the first frame at the new position
+            serialSeek_ = serial_flush(frame.get());
+            timer_.reset();
+            state_.lagDisplayUs = 0;
+            waitBegin = popped;
+            continue;
+        }
+        if (serialSeek_ != state_.serialSeek.load()) {
+            // Rendered before a seek, its marker is on the way
+            waitBegin = popped;
+            continue;
+        }
+        metrics.items.fetch_add(1, std::memory_order_relaxed);
+        bool onTime = waitForPresentation(frame);
+        auto begin = Timer::Clock::now();
+        // Holding the frame back for its deadline
+        metrics.waitOutput.record(elapsedUs(popped, begin));
+        if (!onTime) {
+            countDropped_++;
+            metrics.dropped.fetch_add(1, std::memory_order_relaxed);
+            state_.lagDisplayUs = lagUs_;
+            waitBegin = begin;
+            continue;
+        }
+        uint64_t tag = ++tagDisplay_;
+        {
+            std::lock_guard<std::mutex> lock(mutexPending_);
+            FramePending& pending = framesPending_[tag];
+            pending.deadline = deadline_;
+            pending.seekRequestUs = -1;
+            pending.serialSeek = serialSeek_;
+            if (state_.seeking && serialSeekShown_ != serialSeek_) {
+                serialSeekShown_ = serialSeek_;
+                pending.seekRequestUs = state_.seekRequestUs.load();
+            }
+        }
+        // Latency and bus usage are accounted by onTransfer()
+        screen_->display(frame, tag);
+        auto end = Timer::Clock::now();
+        metrics.process.record(elapsedUs(begin, end));
+        publishFeedback(end - begin);
+        metrics.sampleCpu();
+        waitBegin = end;
+    }
+    // The driver may still be transmitting the last frames
+    screen_->flush();
+    {
+        std::lock_guard<std::mutex> lock(mutexPending_);
+        framesPending_.clear();
+    }
+    if (countDropped_ > 0) {
+        std::cout << "[Video Displayer] Dropped late frames: " 
+            << countDropped_ << std::endl;
+    }
+}
+
+// Tell the decoder how far behind the clock we are and how fast the panel is
+void DisplayerVideo::publishFeedback(Timer::Clock::duration cost)
+{
+    int64_t costUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        cost).count();
+    int64_t costAvgUs = state_.costDisplayUs.load();
+    // Exponential moving average, 1/8 weight for the new sample
+    costAvgUs = costAvgUs == 0 ? costUs : costAvgUs + (costUs - costAvgUs) / 8;
+    state_.costDisplayUs = costAvgUs;
+    state_.lagDisplayUs = lagUs_;
+}
+
+// End of the transfer of a frame, on the thread that put it on the wire
+void DisplayerVideo::onTransfer(const IDisplayer::Transfer& transfer)
+{
+    FramePending pending;
+    {
+        std::lock_guard<std::mutex> lock(mutexPending_);
+        auto it = framesPending_.find(transfer.tag);
+        if (it == framesPending_.end()) {
+            return;
+        }
+        pending = it->second;
+        framesPending_.erase(it);
+        if (!transfer.shown && pending.seekRequestUs >= 0) {
+            // The next frame of that seek stands in
+            serialSeekShown_ = 0;
+        }
+    }
+    if (!transfer.shown) {
+        return;
+    }
+    if (pending.seekRequestUs >= 0
+        && pending.serialSeek == state_.serialSeek.load()) {
+        state_.seeking = false;
+        telemetry_.addSeek(Timer::nowUs() - pending.seekRequestUs);
+    }
+    telemetry_.addFrameDisplayed(transfer.bytes, transfer.busTimeNs,
+        pending.deadline == Timer::Clock::time_point::max()
+            ? AV_NOPTS_VALUE : elapsedUs(pending.deadline, transfer.end));
+}
+
+int64_t DisplayerVideo::elapsedUs(Timer::Clock::time_point from, 
+    Timer::Clock::time_point to)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+void DisplayerVideo::syncTimer()
+{
+    if (state_.paused && !timer_.isPaused()) {
+        timer_.pause();
+    } else if (!state_.paused && timer_.isPaused()) {
+        timer_.resume();
+    }
+    timer_.setSpeed(state_.speed);
+}
+
+// Block until the frame is due on the presentation clock
+// Returns false if the frame is already late and should be dropped
+bool DisplayerVideo::waitForPresentation(const std::shared_ptr<AVFrame>& frame)
+{
+    lagUs_ = 0;
+    deadline_ = Timer::Clock::time_point::max();
+    if (!config_.enablePacing || frame->pts == AV_NOPTS_VALUE) {
+        return true;
+    }
+    int64_t ptsUs = av_rescale_q(frame->pts, 
+        frameParSrc_.getTimeBase(), AV_TIME_BASE_Q);
+
+    syncTimer();
+    if (!timer_.isStarted()) {
+        timer_.start(ptsUs);
+    }
+
     while (state_.running.load()) {
-        auto frame = make_avframe();
-        queueFrame_.pop(frame);
-        screen_->display(frame);
+        syncTimer();
+        auto now = Timer::Clock::now();
+        if (timer_.isPaused()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(SLICE_WAIT_US));
+            continue;
+        }
+        auto deadline = timer_.getDeadline(ptsUs);
+        int64_t aheadUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - now).count();
+        if (aheadUs > THRESHOLD_DISCONTINUITY_US
+            || -aheadUs > Timer::THRESHOLD_RESYNC_US) {
+            // Timestamp discontinuity or a long stall upstream:
+            // restart the clock from this frame rather than waiting/dropping
+            timer_.start(ptsUs);
+            lagUs_ = 0;
+            deadline_ = timer_.getDeadline(ptsUs);
+            return true;
+        }
+        if (aheadUs <= 0) {
+            lagUs_ = -aheadUs;
+            deadline_ = deadline;
+            return -aheadUs <= config_.thresholdDropLateUs;
+        }
+        std::this_thread::sleep_until(
+            std::min(deadline, now + std::chrono::microseconds(SLICE_WAIT_US)));
     }
+    return false;
 }
 
 }
\ No newline at end of file
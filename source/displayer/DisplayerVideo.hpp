@@ -4,35 +4,84 @@
 #include "ffmpeg.hpp"
 
 #include "IDisplayer.hpp"
+#include "Timer.hpp"
+#include "Telemetry.hpp"
+
+#include <map>
 
 namespace bplayer {
 
 class DisplayerVideo {
 public:
-    DisplayerVideo(BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+    DisplayerVideo(PipeQueue<std::shared_ptr<AVFrame>>& queueFrame, 
+        Timer& timer,
         PlayerState& state,
         PlayerConfig& config,
+        Telemetry& telemetry,
         FrameParameter& frameParSrc, 
         FrameParameter& frameParDst);
     ~DisplayerVideo();
 
     void run();
 
-    bool init(Orientation orientation, 
-        int width, 
+    // Creates and resets the panel, the area follows once the source
+    // picture is known
+    bool open(Orientation orientation);
+    // Bounding box of the area setArea() may pick, -1 = up to the panel
+    void getSizeTarget(int width, int height, 
+        int& widthTarget, int& heightTarget) const;
+    bool setArea(int width, 
         int height, 
         int offsetX, 
         int offsetY);
 
+    IDisplayer* getScreen();
+
 private:
+    // Sleep slice while waiting for a deadline, keeps pause/speed responsive
+    static constexpr int64_t SLICE_WAIT_US = 10000;
+    // Frames due further ahead than this are treated as a pts jump
+    static constexpr int64_t THRESHOLD_DISCONTINUITY_US = 5000000;
+
     std::unique_ptr<IDisplayer> screen_;
-    BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame_;
+    PipeQueue<std::shared_ptr<AVFrame>>& queueFrame_;
+    Timer& timer_;
     
     PlayerState& state_;
     PlayerConfig& config_;
+    Telemetry& telemetry_;
     
     FrameParameter& frameParSrc_;
     FrameParameter& frameParDst_;
+
+    uint64_t countDropped_ = 0;
+    // Serial of the last seek marker shown through
+    uint64_t serialSeek_ = 0;
+    // Serial whose first frame went to the panel already, under
+    // mutexPending_
+    uint64_t serialSeekShown_ = 0;
+    // Lateness of the frame last released by waitForPresentation()
+    int64_t lagUs_ = 0;
+    // Deadline of that frame, max() when it carried no pts
+    Timer::Clock::time_point deadline_;
+    // Frames handed to the panel and not on it yet, by display() tag;
+    // completed from the transmit thread
+    struct FramePending {
+        Timer::Clock::time_point deadline;
+        // First frame after the seek of this serial, -1 = none
+        int64_t seekRequestUs;
+        uint64_t serialSeek;
+    };
+    std::map<uint64_t, FramePending> framesPending_;
+    std::mutex mutexPending_;
+    uint64_t tagDisplay_ = 0;
+
+    static int64_t elapsedUs(Timer::Clock::time_point from, 
+        Timer::Clock::time_point to);
+    void syncTimer();
+    bool waitForPresentation(const std::shared_ptr<AVFrame>& frame);
+    void publishFeedback(Timer::Clock::duration cost);
+    void onTransfer(const IDisplayer::Transfer& transfer);
 };
     
 }
\ No newline at end of file
@@ -3,11 +3,62 @@
 #include "common.hpp"
 #include "ffmpeg.hpp"
 
+#include <functional>
+
 namespace bplayer
 {
 
+// Layout of the buffer a panel driver puts on the wire
+struct FrameLayout {
+    AVPixelFormat pixFmt = AV_PIX_FMT_NONE;
+    // Pixels covered by the buffer
+    int width = 0;
+    int height = 0;
+    // Bytes per row, or per page when page packed
+    int stride = 0;
+    // Rows, or pages when page packed
+    int rows = 0;
+    // Bytes reserved in front of the pixels for a bus header
+    int prefix = 0;
+    bool bigEndian = false;
+    // 8 vertical pixels per byte, LSB on top (SSD1306 GDDRAM)
+    bool pagePacked = false;
+
+    size_t sizePixels() const {
+        return static_cast<size_t>(stride) * rows;
+    }
+    size_t sizeTransfer() const {
+        return prefix + sizePixels();
+    }
+};
+
+// Where pixel (x, y) of the display area lands in a page packed buffer:
+// column = col0 + x * colX + y * colY, row = row0 + x * rowX + y * rowY
+struct PageMap {
+    int col0 = 0;
+    int colX = 1;
+    int colY = 0;
+    int row0 = 0;
+    int rowX = 0;
+    int rowY = 1;
+};
+
 class IDisplayer {
 public:
+    // Completion of one frame passed to display(), reported by the thread
+    // that put it on the wire once its transfer has ended
+    struct Transfer {
+        // Value the caller passed to display()
+        uint64_t tag = 0;
+        // Bytes and modelled wire time of this frame alone
+        uint64_t bytes = 0;
+        int64_t busTimeNs = 0;
+        std::chrono::steady_clock::time_point end;
+        // False when the frame could not be put on the panel
+        bool shown = false;
+    };
+    using CallbackTransfer = std::function<void(const Transfer&)>;
+
     explicit IDisplayer(FrameParameter& frameParSrc, 
         FrameParameter& frameParDst,
         PlayerConfig& config)
@@ -24,8 +75,87 @@ public:
     }
     virtual void setArea(int width = -1, int height = -1, 
         int offsetX = -1, int offsetY = -1) = 0;
+    // Panel size in the current orientation, the largest possible area
+    virtual void getSizeScreen(int& width, int& height) const = 0;
     virtual bool syncFramePar() = 0;
-    virtual void display(std::shared_ptr<AVFrame> frame) = 0;
+    // Drivers transmitting asynchronously may return before the frame is
+    // on the wire, the transfer callback tells when it is
+    virtual void display(std::shared_ptr<AVFrame> frame, uint64_t tag) = 0;
+    // Block until every frame passed to display() is on the panel
+    virtual void flush() {}
+    // Called once for every frame passed to display(), possibly from the
+    // transmit thread; set it before playing
+    void setCallbackTransfer(CallbackTransfer callback) {
+        callbackTransfer_ = std::move(callback);
+    }
+
+    // Native layout of the transfer buffer, valid after syncFramePar()
+    virtual FrameLayout getNativeLayout() const {
+        FrameLayout layout;
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frameParDst_.pixFmt);
+        if (!desc) {
+            return layout;
+        }
+        layout.pixFmt = frameParDst_.pixFmt;
+        layout.width = frameParDst_.width;
+        layout.height = frameParDst_.height;
+        layout.stride = (layout.width * av_get_bits_per_pixel(desc) + 7) / 8;
+        layout.rows = layout.height;
+        layout.bigEndian = desc->flags & AV_PIX_FMT_FLAG_BE;
+        return layout;
+    }
+
+    // Back "frame" with a driver-owned transfer buffer in native layout,
+    // display() then puts it on the bus without copying
+    virtual bool allocFrame(AVFrame* frame) {
+        FrameLayout layout = getNativeLayout();
+        size_t size = layout.sizeTransfer();
+        if (size == 0) {
+            return false;
+        }
+        uint8_t* data = static_cast<uint8_t*>(av_mallocz(size));
+        if (!data) {
+            return false;
+        }
+        frame->buf[0] = av_buffer_create(data, size, 
+            av_buffer_default_free, nullptr, 0);
+        if (!frame->buf[0]) {
+            av_free(data);
+            return false;
+        }
+        frame->data[0] = data + layout.prefix;
+        frame->linesize[0] = layout.stride;
+        frame->width = layout.width;
+        frame->height = layout.height;
+        frame->format = layout.pixFmt;
+        frame->opaque = this;
+        return true;
+    }
+
+    // Convert a frame in frameParDst_ format into the native layout,
+    // needed when the layout can not be produced by the scaler directly
+    virtual bool packFrame(const AVFrame* src, AVFrame* dst) {
+        return false;
+    }
+
+    // Page packed layouts: orientation and placement of the display area,
+    // so a renderer can write the pages itself instead of packFrame()
+    virtual bool getPageMap(PageMap& map) const {
+        return false;
+    }
+
+    bool isNativeFrame(const AVFrame* frame) const {
+        return frame && frame->opaque == this;
+    }
+
+    // Bytes put on the bus since construction, commands included
+    uint64_t getBytesBus() const {
+        return bytesBus_.load(std::memory_order_relaxed);
+    }
+    // Modelled wire time of those bytes, only known to virtual panels
+    int64_t getBusTimeNs() const {
+        return busTimeNs_.load(std::memory_order_relaxed);
+    }
 
     FrameParameter& frameParSrc_;
     FrameParameter& frameParDst_;
@@ -34,6 +164,41 @@ public:
 
 protected:
     Orientation orientation_ = Orientation::Landscape;
+
+    void countBus(size_t bytes, int64_t wireNs = 0) {
+        bytesBus_.fetch_add(bytes, std::memory_order_relaxed);
+        busTimeNs_.fetch_add(wireNs, std::memory_order_relaxed);
+    }
+
+    // Around the bus writes of one frame; while playing nothing else
+    // writes to the bus (see TransmitWorker), the deltas are its own
+    void beginTransfer(Transfer& transfer) const {
+        transfer.bytes = getBytesBus();
+        transfer.busTimeNs = getBusTimeNs();
+    }
+    void endTransfer(Transfer& transfer) {
+        transfer.bytes = getBytesBus() - transfer.bytes;
+        transfer.busTimeNs = getBusTimeNs() - transfer.busTimeNs;
+        transfer.end = std::chrono::steady_clock::now();
+        transfer.shown = true;
+        if (callbackTransfer_) {
+            callbackTransfer_(transfer);
+        }
+    }
+    // A frame that never reaches the bus
+    void failTransfer(uint64_t tag) {
+        Transfer transfer;
+        transfer.tag = tag;
+        transfer.end = std::chrono::steady_clock::now();
+        if (callbackTransfer_) {
+            callbackTransfer_(transfer);
+        }
+    }
+
+private:
+    CallbackTransfer callbackTransfer_;
+    std::atomic<uint64_t> bytesBus_{0};
+    std::atomic<int64_t> busTimeNs_{0};
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <functional>
+
+namespace bplayer
+{
+
+// Transfer slots and the thread putting them on the bus
+// A driver acquires a free slot, prepares the next frame into it (pack,
+// gather) and submits it; the worker transmits the slots in order while
+// the driver already prepares the next one. acquire() blocks while every
+// slot is queued or on the wire, which is the back-pressure towards the
+// display stage. With less than two slots nothing can overlap, jobs are
+// then transmitted inline by submit().
+//
+// Contract with the drivers using it:
+// - While frames play only "transmit" touches the bus. Commands, window
+//   changes or clearing run before playback or after drain().
+// - "transmit" ends by dropping the job's references to pooled frames,
+//   so a frame goes back to its pool once it is on the wire rather than
+//   when its slot is reused.
+// - "transmit" may call virtual hooks of a derived panel (an emulated
+//   bus), so the most derived destructor stops the worker before its
+//   own members go away.
+template<typename Job>
+class TransmitWorker {
+public:
+    using Transmit = std::function<void(Job&)>;
+
+    TransmitWorker() = default;
+    ~TransmitWorker() {
+        stop();
+    }
+
+    // "setup" runs once per slot, to allocate its buffers
+    void start(size_t count, Transmit transmit,
+        const std::function<void(Job&)>& setup) {
+        stop();
+        transmit_ = std::move(transmit);
+        count = std::max<size_t>(count, 1);
+        for (size_t i = 0; i < count; i++) {
+            jobs_.push_back(std::make_unique<Job>());
+            setup(*jobs_.back());
+            free_.push(jobs_.back().get());
+        }
+        threaded_ = count > 1;
+        if (threaded_) {
+            running_ = true;
+            thread_ = std::thread(&TransmitWorker::run, this);
+        }
+    }
+
+    // Transmit what is queued, then release the slots
+    void stop() {
+        if (thread_.joinable()) {
+            drain();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_ = false;
+            }
+            cvReady_.notify_one();
+            thread_.join();
+        }
+        threaded_ = false;
+        jobs_.clear();
+        free_ = std::queue<Job*>();
+        ready_ = std::queue<Job*>();
+    }
+
+    // nullptr before start()
+    Job* acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (jobs_.empty()) {
+            return nullptr;
+        }
+        cvFree_.wait(lock, [&]() {
+            return !free_.empty();
+        });
+        Job* job = free_.front();
+        free_.pop();
+        return job;
+    }
+
+    void submit(Job* job) {
+        if (!threaded_) {
+            transmit_(*job);
+            release(job);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.push(job);
+        }
+        cvReady_.notify_one();
+    }
+
+    // Give back a slot that turned out to have nothing to send
+    void release(Job* job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push(job);
+        }
+        cvFree_.notify_all();
+    }
+
+    // Block until every submitted slot is on the bus
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cvFree_.wait(lock, [&]() {
+            return ready_.empty() && transmitting_ == 0;
+        });
+    }
+
+    bool isThreaded() const {
+        return threaded_;
+    }
+
+private:
+    std::vector<std::unique_ptr<Job>> jobs_;
+    std::queue<Job*> free_;
+    std::queue<Job*> ready_;
+    // Slots on the wire right now
+    size_t transmitting_ = 0;
+    Transmit transmit_;
+    std::thread thread_;
+    bool running_ = false;
+    bool threaded_ = false;
+    std::mutex mutex_;
+    std::condition_variable cvFree_;
+    std::condition_variable cvReady_;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cvReady_.wait(lock, [&]() {
+                return !running_ || !ready_.empty();
+            });
+            if (ready_.empty()) {
+                break;
+            }
+            Job* job = ready_.front();
+            ready_.pop();
+            transmitting_++;
+            lock.unlock();
+            transmit_(*job);
+            lock.lock();
+            transmitting_--;
+            free_.push(job);
+            cvFree_.notify_all();
+        }
+    }
+};
+
+}
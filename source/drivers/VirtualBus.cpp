@@ -0,0 +1,87 @@
+#include "VirtualBus.hpp"
+
+namespace bplayer
+{
+
+VirtualBus::VirtualBus(uint32_t clockHz, int bitsPerByte, int bitsOverhead,
+    int64_t overheadNs)
+    : clockHz_(clockHz),
+        bitsPerByte_(bitsPerByte),
+        bitsOverhead_(bitsOverhead),
+        overheadNs_(overheadNs)
+{
+
+}
+
+VirtualBus::~VirtualBus()
+{
+
+}
+
+void VirtualBus::setRealtime(bool realtime)
+{
+    realtime_ = realtime;
+    deadline_ = std::chrono::steady_clock::now();
+}
+
+void VirtualBus::setClock(uint32_t clockHz)
+{
+    if (clockHz > 0) {
+        clockHz_ = clockHz;
+    }
+}
+
+int64_t VirtualBus::transfer(size_t bytes)
+{
+    uint64_t bits = static_cast<uint64_t>(bytes) * bitsPerByte_ + bitsOverhead_;
+    int64_t ns = static_cast<int64_t>(bits * 1000000000ull / clockHz_) + overheadNs_;
+    stats_.transactions++;
+    stats_.bytes += bytes;
+    stats_.wireNs += ns;
+    occupy(ns);
+    return ns;
+}
+
+void VirtualBus::delay(int64_t us)
+{
+    stats_.delayNs += us * 1000;
+    occupy(us * 1000);
+}
+
+void VirtualBus::beginFrame()
+{
+    wireNsFrameBegin_ = stats_.wireNs;
+}
+
+void VirtualBus::endFrame()
+{
+    stats_.frames++;
+    stats_.frameWireNs += stats_.wireNs - wireNsFrameBegin_;
+}
+
+VirtualBus::Stats VirtualBus::getStats() const
+{
+    return stats_;
+}
+
+void VirtualBus::reset()
+{
+    stats_ = Stats();
+    wireNsFrameBegin_ = 0;
+    deadline_ = std::chrono::steady_clock::now();
+}
+
+void VirtualBus::occupy(int64_t ns)
+{
+    if (!realtime_) {
+        return;
+    }
+    // The bus is busy until "deadline_", an idle bus starts from now
+    auto now = std::chrono::steady_clock::now();
+    deadline_ = std::max(deadline_, now) + std::chrono::nanoseconds(ns);
+    if (deadline_ - now >= std::chrono::nanoseconds(SLICE_SLEEP_NS)) {
+        std::this_thread::sleep_until(deadline_);
+    }
+}
+
+}
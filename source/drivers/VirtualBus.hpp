@@ -0,0 +1,65 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace bplayer
+{
+
+// Wire time model of a serial panel bus, used by the virtual panels
+// A transaction costs its bits at the bus clock plus a fixed number of
+// protocol bits (I2C start/address/stop) and a fixed software overhead
+// (syscall, chip select). With "realtime" the caller is held back until
+// the modelled wire time has passed, so the pipeline sees the real pace.
+class VirtualBus {
+public:
+    struct Stats {
+        uint64_t transactions = 0;
+        uint64_t bytes = 0;
+        int64_t wireNs = 0;
+        // Delays requested by the driver (reset pulses, power up)
+        int64_t delayNs = 0;
+        // Frames and the wire time spent inside them
+        uint64_t frames = 0;
+        int64_t frameWireNs = 0;
+
+        // Frame rate the wire allows, 0 before the first frame
+        double fpsLimit() const {
+            return frameWireNs > 0 ? frames * 1e9 / frameWireNs : 0.0;
+        }
+    };
+
+    // "bitsPerByte" 8 for SPI, 9 for I2C (ACK bit)
+    VirtualBus(uint32_t clockHz, int bitsPerByte, int bitsOverhead,
+        int64_t overheadNs);
+    ~VirtualBus();
+
+    void setRealtime(bool realtime);
+    void setClock(uint32_t clockHz);
+
+    // Returns the modelled wire time in ns
+    int64_t transfer(size_t bytes);
+    void delay(int64_t us);
+    // Brackets the transfers of one displayed frame
+    void beginFrame();
+    void endFrame();
+
+    Stats getStats() const;
+    void reset();
+
+private:
+    // Shorter waits are accumulated, sleeping per byte would be all overhead
+    static constexpr int64_t SLICE_SLEEP_NS = 1000000;
+
+    uint32_t clockHz_;
+    const int bitsPerByte_;
+    const int bitsOverhead_;
+    const int64_t overheadNs_;
+    bool realtime_ = false;
+    Stats stats_;
+    int64_t wireNsFrameBegin_ = 0;
+    std::chrono::steady_clock::time_point deadline_;
+
+    void occupy(int64_t ns);
+};
+
+}
@@ -0,0 +1,115 @@
+#include "NullDisplayer.hpp"
+
+namespace bplayer
+{
+
+DisplayerNull::DisplayerNull(FrameParameter& frameParSrc,
+    FrameParameter& frameParDst,
+    PlayerConfig& config)
+    : IDisplayer(frameParSrc, frameParDst, config)
+{
+
+}
+
+DisplayerNull::~DisplayerNull()
+{
+
+}
+
+bool DisplayerNull::init()
+{
+    pixFmt_ = config_.pixFmtNull;
+    if (pixFmt_ == AV_PIX_FMT_MONOBLACK || pixFmt_ == AV_PIX_FMT_MONOWHITE) {
+        config_.flagsScaler = SWS_BICUBIC;
+        config_.flagsDither = SWS_DITHER_ED;
+    }
+    countFrames_ = 0;
+    return true;
+}
+
+void DisplayerNull::reset()
+{
+    clear();
+}
+
+void DisplayerNull::clear()
+{
+
+}
+
+void DisplayerNull::getSizeScreen(int& width, int& height) const
+{
+    bool portrait = orientation_ == Orientation::Portrait
+        || orientation_ == Orientation::PortraitInverted;
+    width = portrait ? screenHeight : screenWidth;
+    height = portrait ? screenWidth : screenHeight;
+}
+
+// Same rules as the real panels: keep the aspect ratio, fit the screen
+// Offsets only matter on the wire, so they are ignored here.
+void DisplayerNull::setArea(int width, int height,
+    int offsetX, int offsetY)
+{
+    int limitX = 0;
+    int limitY = 0;
+    getSizeScreen(limitX, limitY);
+    double ratioWHTarget = static_cast<double>(frameParSrc_.width)
+        / frameParSrc_.height;
+    DisplayArea areaTarget{width, height};
+    if (width != -1 && height != -1) {
+        ratioWHTarget = static_cast<double>(width) / height;
+    } else if (width != -1) {
+        areaTarget.height = static_cast<int>(std::round(width / ratioWHTarget));
+    } else if (height != -1) {
+        areaTarget.width = static_cast<int>(std::round(height * ratioWHTarget));
+    } else {
+        areaTarget.width = frameParSrc_.width;
+        areaTarget.height = frameParSrc_.height;
+    }
+    if (areaTarget.width > limitX) {
+        areaTarget.width = limitX;
+        areaTarget.height = static_cast<int>(std::round(limitX / ratioWHTarget));
+    }
+    if (areaTarget.height > limitY) {
+        areaTarget.height = limitY;
+        areaTarget.width = static_cast<int>(std::round(limitY * ratioWHTarget));
+    }
+    displayArea.width = std::max(areaTarget.width, 1);
+    displayArea.height = std::max(areaTarget.height, 1);
+
+    std::cout << "[Null Displayer] Display area: "
+        << displayArea.width << " * " << displayArea.height << " "
+        << av_get_pix_fmt_name(pixFmt_) << std::endl;
+}
+
+bool DisplayerNull::syncFramePar()
+{
+    if (displayArea.width <= 0 || displayArea.height <= 0) {
+        return false;
+    }
+    frameParDst_.pixFmt = pixFmt_;
+    frameParDst_.width = displayArea.width;
+    frameParDst_.height = displayArea.height;
+    return true;
+}
+
+void DisplayerNull::display(std::shared_ptr<AVFrame> frame, uint64_t tag)
+{
+    if (!frame) {
+        failTransfer(tag);
+        return;
+    }
+    Transfer transfer;
+    transfer.tag = tag;
+    beginTransfer(transfer);
+    countBus(getNativeLayout().sizeTransfer());
+    countFrames_++;
+    endTransfer(transfer);
+}
+
+uint64_t DisplayerNull::getCountFrames() const
+{
+    return countFrames_;
+}
+
+}
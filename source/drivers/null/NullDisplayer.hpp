@@ -0,0 +1,39 @@
+#pragma once
+
+#include "IDisplayer.hpp"
+
+namespace bplayer
+{
+
+// Panel without hardware behind it
+// Behaves like a 160x128 screen in PlayerConfig::pixFmtNull: frames are
+// accounted as if they went over the bus and then discarded. Used to
+// measure the pipeline on machines without SPI/I2C.
+class DisplayerNull : public IDisplayer {
+public:
+    const int screenWidth = 160;
+    const int screenHeight = 128;
+
+    explicit DisplayerNull(FrameParameter& frameParSrc,
+        FrameParameter& frameParDst,
+        PlayerConfig& config);
+    ~DisplayerNull();
+
+    bool init() override;
+    void reset() override;
+    void clear() override;
+    void setArea(int width = -1, int height = -1,
+        int offsetX = -1, int offsetY = -1) override;
+    void getSizeScreen(int& width, int& height) const override;
+    bool syncFramePar() override;
+    void display(std::shared_ptr<AVFrame> frame, uint64_t tag) override;
+
+    uint64_t getCountFrames() const;
+
+private:
+    struct DisplayArea{int width; int height;} displayArea{-1, -1};
+    AVPixelFormat pixFmt_ = AV_PIX_FMT_RGB565BE;
+    uint64_t countFrames_ = 0;
+};
+
+}
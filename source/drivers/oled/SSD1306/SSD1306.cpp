@@ -18,7 +18,10 @@ DisplayerSSD1306::DisplayerSSD1306(FrameParameter& frameParSrc,
 
 DisplayerSSD1306::~DisplayerSSD1306()
 {
-    close(i2c_fd);
+    stopTransmit();
+    if (i2c_fd >= 0) {
+        close(i2c_fd);
+    }
 }
 
 bool DisplayerSSD1306::configure(const std::string& i2c_dev)
@@ -41,7 +44,7 @@ bool DisplayerSSD1306::init()
     config_.flagsScaler = SWS_BICUBIC;
     config_.flagsDither = SWS_DITHER_ED;
     
-    if (!configure("/dev/i2c-3")) {
+    if (!openBus()) {
         return false;
     }
     
@@ -104,6 +107,7 @@ void DisplayerSSD1306::reset()
 
 void DisplayerSSD1306::clear()
 {
+    worker_.drain();
     std::vector<uint8_t> buffer(128 * 8, 0x00);
     writeData(buffer.data(), buffer.size());
 }
@@ -130,14 +134,22 @@ void DisplayerSSD1306::setOrientation(Orientation orientation)
         direction[1] = 1;
         break;
     }
+    selectPackFunc();
+}
+
+void DisplayerSSD1306::getSizeScreen(int& width, int& height) const
+{
+    width = direction[1] ? screenHeight : screenWidth;
+    height = direction[1] ? screenWidth : screenHeight;
 }
 
 void DisplayerSSD1306::setArea(int width, int height, 
     int offsetX, int offsetY)
 {
-    // Limit: pidisplayRange.xEl count
-    int limitX = direction[1] ? (screenHeight) : (screenWidth);
-    int limitY = direction[1] ? (screenWidth) : (screenHeight);
+    // Limit: pixel count
+    int limitX = 0;
+    int limitY = 0;
+    getSizeScreen(limitX, limitY);
     DisplayArea areaTarget{-1,-1};
     double ratioWHTarget = static_cast<double>(frameParSrc_.width)
         / frameParSrc_.height;
@@ -310,67 +322,125 @@ bool DisplayerSSD1306::syncFramePar()
     frameParDst_.pixFmt = pixFmtRenderer;
     frameParDst_.width = displayArea.width;
     frameParDst_.height = displayArea.height;
-    return true;
+    selectPackFunc();
+    bool ok = true;
+    worker_.start(std::max(config_.countBuffersTransmit.load(), 1),
+        [this](JobTransmit& job) { transmit(job); },
+        [this, &ok](JobTransmit& job) {
+            job.frameTransfer = make_avframe();
+            ok = ok && job.frameTransfer && allocFrame(job.frameTransfer.get());
+        });
+    std::cout << "[SSD1306] Transmit buffers: " 
+        << config_.countBuffersTransmit.load() 
+        << (worker_.isThreaded() ? " (async)" : " (sync)") << std::endl;
+    return ok;
 }
 
-void DisplayerSSD1306::display(std::shared_ptr<AVFrame> frame)
+void DisplayerSSD1306::display(std::shared_ptr<AVFrame> frame, uint64_t tag)
 {
-    if (frame -> width!=displayArea.width 
-        || frame->height != displayArea.height) {
-        std::cerr << "[SSD1306] Frame fail to match parameters" << std::endl;
+    JobTransmit* job = worker_.acquire();
+    if (!job) {
+        failTransfer(tag);
         return;
     }
-    std::vector<std::vector<bool>> bitMap(64, std::vector<bool>(128, false));
-    int srcStride = frame->linesize[0];
-    const uint8_t* srcData = frame->data[0];
-
-    for (int srcY = 0; srcY < frame->height; ++srcY) {
-        for (int srcX = 0; srcX < frame->width; ++srcX) {
-            int indexByte = srcX / 8;
-            int indexBit = 7 - (srcX % 8);
-            bool isWhite = (srcData[srcY * srcStride + indexByte] >> indexBit) & 0x01;
-
-            int dstX = 0, dstY = 0;
-
-            switch(orientation_) {
-            case Orientation::Landscape:
-                dstX = displayRange.xS + srcX;
-                dstY = displayRange.yS + srcY;
-                break;
-            case Orientation::LandscapeInverted:
-                dstX = displayRange.xE - srcX;
-                dstY = displayRange.yE - srcY;
-                break;
-            case Orientation::Portrait:
-                dstX = displayRange.yS + srcY;
-                dstY = displayRange.xE - srcX;
-                break;
-            case Orientation::PortraitInverted:
-                dstX = displayRange.yE - srcY;
-                dstY = displayRange.xS + srcX;
-            }
-
-            if (dstX >= 0 && dstX < screenWidth && dstY >= 0 && dstY <screenHeight) {
-                bitMap[dstY][dstX] = isWhite;
-            }
-        }
+    job->transfer.tag = tag;
+    if (isNativeFrame(frame.get())) {
+        job->data = frame->buf[0]->data;
+        job->frame = std::move(frame);
+    } else if (packFrame(frame.get(), job->frameTransfer.get())) {
+        // Row-major MONOBLACK frame: packed into the slot's own buffer
+        job->data = job->frameTransfer->buf[0]->data;
+    } else {
+        worker_.release(job);
+        failTransfer(tag);
+        return;
     }
+    worker_.submit(job);
+}
 
-    std::vector<uint8_t> ssd1306Buf(128 * 8, 0);
+void DisplayerSSD1306::flush()
+{
+    worker_.drain();
+}
 
-    for (int page = 0; page < 8; ++page) {
-        for (int col = 0; col < 128; ++col) {
-            uint8_t byte = 0;
-            for (int bit = 0; bit < 8; ++bit) {
-                if (bitMap[page * 8 + bit][col]) {
-                    byte |= (1 << bit);
-                }
-            }
-            ssd1306Buf[page * 128 + col] = byte;
-        }
+void DisplayerSSD1306::stopTransmit()
+{
+    worker_.stop();
+}
+
+void DisplayerSSD1306::transmit(JobTransmit& job)
+{
+    beginTransfer(job.transfer);
+    beginFrameBus();
+    writeTransfer(job.data, getNativeLayout().sizeTransfer());
+    endFrameBus();
+    endTransfer(job.transfer);
+    job.frame.reset();
+}
+
+FrameLayout DisplayerSSD1306::getNativeLayout() const
+{
+    FrameLayout layout;
+    layout.pixFmt = pixFmtRenderer;
+    layout.width = screenWidth;
+    layout.height = screenHeight;
+    // GDDRAM in horizontal addressing mode: 8 pages of 128 columns
+    layout.stride = screenWidth;
+    layout.rows = screenHeight / 8;
+    // I2C control byte: Co = 0, D/C# = 1
+    layout.prefix = 1;
+    layout.pagePacked = true;
+    return layout;
+}
+
+bool DisplayerSSD1306::allocFrame(AVFrame* frame)
+{
+    if (!IDisplayer::allocFrame(frame)) {
+        return false;
+    }
+    frame->buf[0]->data[0] = 0x40;
+    return true;
+}
+
+bool DisplayerSSD1306::packFrame(const AVFrame* src, AVFrame* dst)
+{
+    if (src->width != displayArea.width 
+        || src->height != displayArea.height) {
+        std::cerr << "[SSD1306] Frame fail to match parameters" << std::endl;
+        return false;
     }
+    if (!packFunc_) {
+        std::cerr << "[SSD1306] Unsupported frame format" << std::endl;
+        return false;
+    }
+    PackParameter par{src->data[0], src->linesize[0], src->width, src->height, 
+        dst->data[0], screenWidth, screenHeight / 8, 
+        displayRange.xS, displayRange.xE, displayRange.yS, displayRange.yE};
+    packFunc_(par);
+    return true;
+}
 
-    writeData(ssd1306Buf.data(), ssd1306Buf.size());
+// Same placement as the pack kernels (see SSD1306Pack.cpp)
+bool DisplayerSSD1306::getPageMap(PageMap& map) const
+{
+    if (displayRange.xS < 0 || displayRange.yS < 0) {
+        return false;
+    }
+    switch (orientation_) {
+    case Orientation::Landscape:
+        map = {displayRange.xS, 1, 0, displayRange.yS, 0, 1};
+        break;
+    case Orientation::LandscapeInverted:
+        map = {displayRange.xE, -1, 0, displayRange.yE, 0, -1};
+        break;
+    case Orientation::Portrait:
+        map = {displayRange.yS, 0, 1, displayRange.xE, -1, 0};
+        break;
+    case Orientation::PortraitInverted:
+        map = {displayRange.yE, 0, -1, displayRange.xS, 1, 0};
+        break;
+    }
+    return true;
 }
 
 void DisplayerSSD1306::colorInversion(bool inversion)
@@ -399,15 +469,16 @@ void DisplayerSSD1306::resetArea()
     }
 }
 
+// Pick the kernel once instead of branching per pixel
+void DisplayerSSD1306::selectPackFunc()
+{
+    packFunc_ = getPackFunc(orientation_, frameParDst_.pixFmt);
+}
+
 bool DisplayerSSD1306::writeCmd(uint8_t cmd)
 {
     uint8_t buffer[2] = {0x00, cmd};
-    int ret = write(i2c_fd, buffer, 2);
-    if (ret < 0) {
-        return false;
-    } else {
-        return true;
-    }
+    return i2cWrite(buffer, 2);
 }
 
 bool DisplayerSSD1306::writeData(const uint8_t* data, size_t len)
@@ -415,10 +486,26 @@ bool DisplayerSSD1306::writeData(const uint8_t* data, size_t len)
     std::vector<uint8_t> buffer(len + 1);
     buffer[0] = 0x40;
     std::memcpy(&buffer[1], data, len);
-   int ret = write(i2c_fd, buffer.data(), buffer.size());
-   if (ret < 0) {
+    return i2cWrite(buffer.data(), buffer.size());
+}
+
+bool DisplayerSSD1306::writeTransfer(const uint8_t* buffer, size_t len)
+{
+    return i2cWrite(buffer, len);
+}
+
+bool DisplayerSSD1306::openBus()
+{
+    return configure("/dev/i2c-3");
+}
+
+bool DisplayerSSD1306::i2cWrite(const uint8_t* buffer, size_t len)
+{
+    int ret = write(i2c_fd, buffer, len);
+    if (ret < 0) {
         return false;
     } else {
+        countBus(ret);
         return true;
     }
 }
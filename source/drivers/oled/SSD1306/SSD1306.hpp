@@ -1,4 +1,8 @@
+#pragma once
+
 #include "IDisplayer.hpp"
+#include "TransmitWorker.hpp"
+#include "SSD1306Pack.hpp"
 
 namespace bplayer
 {
@@ -22,23 +26,41 @@ public:
     void setOrientation(Orientation orientation) override;
     void setArea(int width = -1, int height = -1, 
         int offsetX = -1, int offsetY = -1) override;
+    void getSizeScreen(int& width, int& height) const override;
     bool syncFramePar() override;
-    void display(std::shared_ptr<AVFrame> frame) override;
+    void display(std::shared_ptr<AVFrame> frame, uint64_t tag) override;
+    void flush() override;
+    FrameLayout getNativeLayout() const override;
+    bool allocFrame(AVFrame* frame) override;
+    bool packFrame(const AVFrame* src, AVFrame* dst) override;
+    bool getPageMap(PageMap& map) const override;
 
     void colorInversion(bool inversion);
     void displayOn(bool on);
     void allWhite(bool on);
     void resetArea();
 
-private:
+protected:
     uint32_t speed = 800000;
+
+    // Hardware access, the only members touching I2C.
+    // DisplayerSSD1306Virtual replaces them with an emulated panel.
+    virtual bool openBus();
+    // One I2C write transaction, "buffer" starts with the control byte
+    virtual bool i2cWrite(const uint8_t* buffer, size_t len);
+    // Around the single I2C write carrying a frame
+    virtual void beginFrameBus() {}
+    virtual void endFrameBus() {}
+    void stopTransmit();
+
+private:
     // Display direction control
     //          D1          D0
     // Orientation   Inversion
     //           x           x
     //     0:L 1:P     0:N 1:I
     std::bitset<2> direction = 0b00;
-    int i2c_fd;
+    int i2c_fd = -1;
     uint8_t i2c_addr = 0x3C;
     struct DisplayArea{int width; int height;} displayArea{-1, -1};
     struct DisplayRange {
@@ -46,9 +68,24 @@ private:
         int width() const {return xE - xS + 1;}
         int height() const {return yE - yS + 1;}
     } displayRange{-1, -1, -1, -1};
+    // One frame ready for the wire: a native frame as is, or packed
+    // into the slot's own transfer buffer
+    struct JobTransmit {
+        std::shared_ptr<AVFrame> frameTransfer;
+        std::shared_ptr<AVFrame> frame;
+        const uint8_t* data = nullptr;
+        Transfer transfer;
+    };
+    TransmitWorker<JobTransmit> worker_;
+    // Packing kernel for the current orientation and renderer format
+    PackFunc packFunc_ = nullptr;
 
+    void selectPackFunc();
+    void transmit(JobTransmit& job);
     bool writeCmd(uint8_t cmd);
     bool writeData(const uint8_t* data, size_t len);
+    // "buffer" starts with the data control byte already
+    bool writeTransfer(const uint8_t* buffer, size_t len);
     void setContrast(uint8_t step);
 };
 
@@ -0,0 +1,157 @@
+#include "SSD1306Pack.hpp"
+
+namespace bplayer
+{
+
+// 8 pixels of a 1 bpp row starting at "x0", MSB first, 1 = white
+// Pixels left of 0 or right of "width" read as black.
+template<AVPixelFormat PixFmt>
+static inline uint8_t extract8(const uint8_t* row, int width, int x0)
+{
+    static_assert(PixFmt == AV_PIX_FMT_MONOBLACK || PixFmt == AV_PIX_FMT_MONOWHITE, 
+        "1 bpp source expected");
+    // MONOWHITE stores 1 = black
+    constexpr uint8_t flip = (PixFmt == AV_PIX_FMT_MONOWHITE) ? 0xFF : 0x00;
+    if (x0 >= width || x0 <= -8) {
+        return 0;
+    }
+    const int indexByte = x0 >> 3;
+    const int shift = x0 & 7;
+    if (x0 >= 0 && x0 + 8 <= width) {
+        if (shift == 0) {
+            return row[indexByte] ^ flip;
+        }
+        uint16_t word = (row[indexByte] << 8) | row[indexByte + 1];
+        return static_cast<uint8_t>(word >> (8 - shift)) ^ flip;
+    }
+    // Straddles an edge of the row
+    const int bytesRow = (width + 7) / 8;
+    uint16_t hi = (indexByte >= 0) ? row[indexByte] : 0;
+    uint16_t lo = (indexByte + 1 < bytesRow) ? row[indexByte + 1] : 0;
+    uint8_t bits = static_cast<uint8_t>(((hi << 8) | lo) >> (8 - shift)) ^ flip;
+    const int lead = std::max(0, -x0);
+    const int end = std::min(8, width - x0);
+    uint8_t mask = static_cast<uint8_t>((0xFF >> lead) & (0xFF << (8 - end)));
+    return bits & mask;
+}
+
+static inline uint8_t reverse8(uint8_t b)
+{
+    b = static_cast<uint8_t>(((b & 0xF0) >> 4) | ((b & 0x0F) << 4));
+    b = static_cast<uint8_t>(((b & 0xCC) >> 2) | ((b & 0x33) << 2));
+    b = static_cast<uint8_t>(((b & 0xAA) >> 1) | ((b & 0x55) << 1));
+    return b;
+}
+
+// 8x8 bit matrix transpose, row 0 in the top byte (Hacker's Delight 7-3)
+static inline uint64_t transpose8(uint64_t x)
+{
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+// Landscape:          dstX = xS + srcX, dstY = yS + srcY
+// LandscapeInverted:  dstX = xE - srcX, dstY = yE - srcY
+// Portrait:           dstX = yS + srcY, dstY = xE - srcX
+// PortraitInverted:   dstX = yE - srcY, dstY = xS + srcX
+template<Orientation Orien, AVPixelFormat PixFmt>
+static void packPages(const PackParameter& par)
+{
+    std::memset(par.pages, 0, static_cast<size_t>(par.columns) * par.pageCount);
+
+    if constexpr (Orien == Orientation::Portrait 
+        || Orien == Orientation::PortraitInverted) {
+        // A GDDRAM column is one source row, no transpose needed
+        constexpr bool inverted = (Orien == Orientation::PortraitInverted);
+        for (int srcY = 0; srcY < par.srcHeight; ++srcY) {
+            int col = inverted ? (par.yE - srcY) : (par.yS + srcY);
+            if (col < 0 || col >= par.columns) {
+                continue;
+            }
+            const uint8_t* row = par.src + srcY * par.srcStride;
+            for (int page = 0; page < par.pageCount; ++page) {
+                // Portrait reads the row right to left, MSB lands on bit 7
+                par.pages[page * par.columns + col] = inverted 
+                    ? reverse8(extract8<PixFmt>(row, par.srcWidth, page * 8 - par.xS))
+                    : extract8<PixFmt>(row, par.srcWidth, par.xE - page * 8 - 7);
+            }
+        }
+    } else {
+        constexpr bool inverted = (Orien == Orientation::LandscapeInverted);
+        const uint8_t* rows[8];
+        for (int page = 0; page < par.pageCount; ++page) {
+            bool pageEmpty = true;
+            for (int bit = 0; bit < 8; ++bit) {
+                int srcY = inverted ? (par.yE - page * 8 - bit) 
+                    : (page * 8 + bit - par.yS);
+                rows[bit] = (srcY >= 0 && srcY < par.srcHeight) 
+                    ? par.src + srcY * par.srcStride : nullptr;
+                pageEmpty = pageEmpty && !rows[bit];
+            }
+            if (pageEmpty) {
+                continue;
+            }
+            uint8_t* dst = par.pages + page * par.columns;
+            for (int c0 = 0; c0 < par.columns; c0 += 8) {
+                // Source pixel of column c0 (inverted: of column c0 + 7)
+                int srcX = inverted ? (par.xE - c0 - 7) : (c0 - par.xS);
+                if (srcX >= par.srcWidth || srcX <= -8) {
+                    continue;
+                }
+                // Feed rows bottom-up so bit k of the result is row k
+                uint64_t block = 0;
+                for (int bit = 7; bit >= 0; --bit) {
+                    uint8_t bits = rows[bit] 
+                        ? extract8<PixFmt>(rows[bit], par.srcWidth, srcX) : 0;
+                    if (inverted) {
+                        bits = reverse8(bits);
+                    }
+                    block = (block << 8) | bits;
+                }
+                if (block == 0) {
+                    continue;
+                }
+                block = transpose8(block);
+                for (int j = 0; j < 8; ++j) {
+                    dst[c0 + j] = static_cast<uint8_t>(block >> (56 - 8 * j));
+                }
+            }
+        }
+    }
+}
+
+template<AVPixelFormat PixFmt>
+static PackFunc getPackFuncFor(Orientation orientation)
+{
+    switch (orientation) {
+    case Orientation::Landscape:
+        return &packPages<Orientation::Landscape, PixFmt>;
+    case Orientation::LandscapeInverted:
+        return &packPages<Orientation::LandscapeInverted, PixFmt>;
+    case Orientation::Portrait:
+        return &packPages<Orientation::Portrait, PixFmt>;
+    case Orientation::PortraitInverted:
+        return &packPages<Orientation::PortraitInverted, PixFmt>;
+    }
+    return nullptr;
+}
+
+PackFunc getPackFunc(Orientation orientation, AVPixelFormat pixFmt)
+{
+    switch (pixFmt) {
+    case AV_PIX_FMT_MONOBLACK:
+        return getPackFuncFor<AV_PIX_FMT_MONOBLACK>(orientation);
+    case AV_PIX_FMT_MONOWHITE:
+        return getPackFuncFor<AV_PIX_FMT_MONOWHITE>(orientation);
+    default:
+        return nullptr;
+    }
+}
+
+}
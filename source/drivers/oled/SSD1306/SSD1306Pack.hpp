@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+namespace bplayer
+{
+
+// Packing of MONOBLACK rows (MSB = leftmost pixel) into SSD1306 GDDRAM
+// pages (one byte = 8 vertical pixels, LSB on top)
+struct PackParameter {
+    const uint8_t* src;
+    int srcStride;
+    int srcWidth;
+    int srcHeight;
+    // Page buffer of "columns" * "pages" bytes, cleared by the kernels
+    uint8_t* pages;
+    int columns;
+    int pageCount;
+    // Display range in logical (oriented) coordinates, inclusive
+    int xS, xE, yS, yE;
+};
+
+using PackFunc = void (*)(const PackParameter& par);
+
+// Kernel instantiated for one Orientation and one source pixel format
+// (AV_PIX_FMT_MONOBLACK or AV_PIX_FMT_MONOWHITE), nullptr if unsupported.
+// Landscape variants transpose 8x8 bit blocks, portrait variants map a
+// source row straight onto a GDDRAM column.
+PackFunc getPackFunc(Orientation orientation, AVPixelFormat pixFmt);
+
+}
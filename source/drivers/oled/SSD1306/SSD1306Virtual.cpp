@@ -0,0 +1,205 @@
+#include "SSD1306Virtual.hpp"
+
+namespace bplayer
+{
+
+DisplayerSSD1306Virtual::DisplayerSSD1306Virtual(FrameParameter& frameParSrc,
+    FrameParameter& frameParDst,
+    PlayerConfig& config)
+    : DisplayerSSD1306(frameParSrc, frameParDst, config),
+        bus_(speed, 9, BITS_OVERHEAD, OVERHEAD_TRANSFER_NS),
+        gddram_(static_cast<size_t>(screenWidth) * PAGES, 0)
+{
+    resetController();
+}
+
+DisplayerSSD1306Virtual::~DisplayerSSD1306Virtual()
+{
+    stopTransmit();
+    VirtualBus::Stats stats = bus_.getStats();
+    std::cout << "[SSD1306 Virtual] " << stats.frames << " frames, "
+        << stats.transactions << " writes, " << stats.bytes << " bytes, wire "
+        << stats.wireNs / 1000000 << "ms, bus limit " << stats.fpsLimit()
+        << " fps @ " << speed << " Hz" << std::endl;
+}
+
+bool DisplayerSSD1306Virtual::getPixel(int x, int y) const
+{
+    if (x < 0 || x >= screenWidth || y < 0 || y >= screenHeight) {
+        return false;
+    }
+    return (gddram_[(y / 8) * screenWidth + x] >> (y % 8)) & 0x01;
+}
+
+const std::vector<uint8_t>& DisplayerSSD1306Virtual::getGddram() const
+{
+    return gddram_;
+}
+
+VirtualBus::Stats DisplayerSSD1306Virtual::getStats() const
+{
+    return bus_.getStats();
+}
+
+bool DisplayerSSD1306Virtual::openBus()
+{
+    if (config_.clockVirtualBusHz > 0) {
+        speed = config_.clockVirtualBusHz;
+    }
+    bus_.setClock(speed);
+    bus_.setRealtime(config_.realtimeVirtualBus);
+    bus_.reset();
+    resetController();
+    return true;
+}
+
+// Control byte: Co (0x80) set means one byte follows and then another
+// control byte, cleared means the rest of the write is of the D/C# kind
+bool DisplayerSSD1306Virtual::i2cWrite(const uint8_t* buffer, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        uint8_t control = buffer[i++];
+        bool isData = control & 0x40;
+        size_t end = (control & 0x80) ? std::min(i + 1, len) : len;
+        for (; i < end; i++) {
+            isData ? data(buffer[i]) : command(buffer[i]);
+        }
+    }
+    countBus(len, bus_.transfer(len));
+    return true;
+}
+
+void DisplayerSSD1306Virtual::beginFrameBus()
+{
+    bus_.beginFrame();
+}
+
+void DisplayerSSD1306Virtual::endFrameBus()
+{
+    bus_.endFrame();
+}
+
+void DisplayerSSD1306Virtual::resetController()
+{
+    cmd_ = 0;
+    paramsPending_ = 0;
+    countParams_ = 0;
+    mode_ = AddressingMode::Page;
+    colStart_ = 0;
+    colEnd_ = screenWidth - 1;
+    pageStart_ = 0;
+    pageEnd_ = PAGES - 1;
+    col_ = 0;
+    page_ = 0;
+    remapSegment_ = false;
+    remapCom_ = false;
+    inverted_ = false;
+    displayOn_ = false;
+    startLine_ = 0;
+}
+
+void DisplayerSSD1306Virtual::command(uint8_t value)
+{
+    if (paramsPending_ > 0) {
+        params_[countParams_++] = value;
+        if (--paramsPending_ > 0) {
+            return;
+        }
+        switch (cmd_) {
+        case 0x20:
+            mode_ = static_cast<AddressingMode>(std::min(params_[0] & 0x03, 2));
+            break;
+        case 0x21:
+            colStart_ = params_[0] & 0x7F;
+            colEnd_ = params_[1] & 0x7F;
+            col_ = colStart_;
+            break;
+        case 0x22:
+            pageStart_ = params_[0] & 0x07;
+            pageEnd_ = params_[1] & 0x07;
+            page_ = pageStart_;
+            break;
+        default:
+            // Contrast, multiplex, offset, clock, precharge, COM pins,
+            // VCOMH and charge pump do not change what GDDRAM holds
+            break;
+        }
+        return;
+    }
+
+    cmd_ = value;
+    countParams_ = 0;
+    switch (value) {
+    case 0x20:
+    case 0x81:
+    case 0x8D:
+    case 0xA8:
+    case 0xD3:
+    case 0xD5:
+    case 0xD9:
+    case 0xDA:
+    case 0xDB:
+        paramsPending_ = 1;
+        return;
+    case 0x21:
+    case 0x22:
+        paramsPending_ = 2;
+        return;
+    case 0xA0:
+    case 0xA1:
+        remapSegment_ = value & 0x01;
+        return;
+    case 0xC0:
+    case 0xC8:
+        remapCom_ = value & 0x08;
+        return;
+    case 0xA6:
+    case 0xA7:
+        inverted_ = value & 0x01;
+        return;
+    case 0xAE:
+    case 0xAF:
+        displayOn_ = value & 0x01;
+        return;
+    default:
+        break;
+    }
+    // Page addressing mode only: lower/higher column nibble, page start
+    if (value <= 0x0F) {
+        col_ = (col_ & 0x70) | value;
+    } else if (value <= 0x1F) {
+        col_ = ((value & 0x07) << 4) | (col_ & 0x0F);
+    } else if (value >= 0xB0 && value <= 0xB7) {
+        page_ = value & 0x07;
+    } else if (value >= 0x40 && value <= 0x7F) {
+        startLine_ = value & 0x3F;
+    }
+}
+
+void DisplayerSSD1306Virtual::data(uint8_t value)
+{
+    gddram_[page_ * screenWidth + col_] = value;
+    switch (mode_) {
+    case AddressingMode::Horizontal:
+        if (++col_ > colEnd_) {
+            col_ = colStart_;
+            page_ = page_ >= pageEnd_ ? pageStart_ : page_ + 1;
+        }
+        break;
+    case AddressingMode::Vertical:
+        if (++page_ > pageEnd_) {
+            page_ = pageStart_;
+            col_ = col_ >= colEnd_ ? colStart_ : col_ + 1;
+        }
+        break;
+    case AddressingMode::Page:
+        // The pointer stays on the page and wraps to column 0
+        if (++col_ >= screenWidth) {
+            col_ = 0;
+        }
+        break;
+    }
+}
+
+}
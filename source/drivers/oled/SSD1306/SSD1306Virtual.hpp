@@ -0,0 +1,73 @@
+#pragma once
+
+#include "SSD1306.hpp"
+#include "VirtualBus.hpp"
+
+namespace bplayer
+{
+
+// SSD1306 driver running against an emulated controller
+// The I2C writes are decoded by control byte (Co, D/C#) into commands and
+// GDDRAM data, honouring the addressing mode and the column/page windows.
+// Each write is charged 9 bits per byte plus start, address and stop.
+class DisplayerSSD1306Virtual : public DisplayerSSD1306 {
+public:
+    explicit DisplayerSSD1306Virtual(FrameParameter& frameParSrc,
+        FrameParameter& frameParDst,
+        PlayerConfig& config);
+    ~DisplayerSSD1306Virtual();
+
+    // Lit state of a pixel in GDDRAM coordinates (segment, COM)
+    bool getPixel(int x, int y) const;
+    // GDDRAM, 8 pages of 128 columns
+    const std::vector<uint8_t>& getGddram() const;
+    VirtualBus::Stats getStats() const;
+
+protected:
+    bool openBus() override;
+    bool i2cWrite(const uint8_t* buffer, size_t len) override;
+    void beginFrameBus() override;
+    void endFrameBus() override;
+
+private:
+    // Start, address byte with ACK and stop
+    static constexpr int BITS_OVERHEAD = 11;
+    // ioctl path of a write() on i2c-dev
+    static constexpr int64_t OVERHEAD_TRANSFER_NS = 10000;
+
+    static constexpr int PAGES = 8;
+
+    enum class AddressingMode : uint8_t {
+        Horizontal = 0,
+        Vertical = 1,
+        Page = 2,
+    };
+
+    VirtualBus bus_;
+    std::vector<uint8_t> gddram_;
+
+    // Command being collected, with the parameters it still expects
+    uint8_t cmd_ = 0;
+    int paramsPending_ = 0;
+    uint8_t params_[2] = {0};
+    int countParams_ = 0;
+
+    AddressingMode mode_ = AddressingMode::Page;
+    int colStart_ = 0;
+    int colEnd_ = 127;
+    int pageStart_ = 0;
+    int pageEnd_ = PAGES - 1;
+    int col_ = 0;
+    int page_ = 0;
+    bool remapSegment_ = false;
+    bool remapCom_ = false;
+    bool inverted_ = false;
+    bool displayOn_ = false;
+    int startLine_ = 0;
+
+    void resetController();
+    void command(uint8_t value);
+    void data(uint8_t value);
+};
+
+}
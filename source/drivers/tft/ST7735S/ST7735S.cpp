@@ -1,5 +1,6 @@
 #include "ST7735S.hpp"
 
+#include <fstream>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -18,9 +19,18 @@ DisplayerST7735S::DisplayerST7735S(FrameParameter& frameParSrc,
 
 DisplayerST7735S::~DisplayerST7735S()
 {
-    gpio_line_rst.release();
-    gpio_line_dc.release();
-    close(spi_fd);
+    stopTransmit();
+#ifdef BPLAYER_HAS_GPIOD
+    if (gpio_line_rst) {
+        gpio_line_rst.release();
+    }
+    if (gpio_line_dc) {
+        gpio_line_dc.release();
+    }
+#endif
+    if (spi_fd >= 0) {
+        close(spi_fd);
+    }
 }
 
 bool DisplayerST7735S::configure(const std::string& spi_dev, 
@@ -29,6 +39,12 @@ bool DisplayerST7735S::configure(const std::string& spi_dev,
         const std::string& gpio_chip_name_dc,
         const uint8_t gpio_offset_dc)
 {
+#ifndef BPLAYER_HAS_GPIOD
+    // Reset and D/C are GPIOs, the panel can not be driven without them
+    std::cerr << "[ST7735S] Built without libgpiod, use the virtual panel" 
+        << std::endl;
+    return false;
+#else
     spi_fd = open(spi_dev.c_str(), O_RDWR);
     if (spi_fd < 0) {
         std::cerr << "[ST7735S] Failed to open SPI device: " 
@@ -70,8 +86,11 @@ bool DisplayerST7735S::configure(const std::string& spi_dev,
         gpiod::line_request::DIRECTION_OUTPUT, 0}, 1);
     gpio_line_dc.request({"st7735s_dc", 
         gpiod::line_request::DIRECTION_OUTPUT, 0}, 1);
-    
+    levelDC_ = 1;
+
+    maxTransfer_ = readBufsizSpidev();
     return true;
+#endif
 }
 
 bool DisplayerST7735S::init()
@@ -79,7 +98,15 @@ bool DisplayerST7735S::init()
     config_.flagsScaler = SWS_BICUBIC;
     config_.flagsDither = SWS_DITHER_ED;
     
-    configure("/dev/spidev3.0", "gpiochip3", 10, "gpiochip3", 17);
+    if (!openBus()) {
+        return false;
+    }
+    // The configured size can only lower the spidev limit
+    if (config_.maxTransferSpi > 0) {
+        maxTransfer_ = std::min<size_t>(config_.maxTransferSpi, maxTransfer_);
+    }
+    std::cout << "[ST7735S] SPI message limit: " << maxTransfer_ 
+        << " bytes" << std::endl;
 
     // Panel Resolution Select:
     // GM2=0 GM1=1 GM0=1
@@ -150,9 +177,9 @@ bool DisplayerST7735S::init()
 void DisplayerST7735S::reset()
 {
     // Set RST to "0" for reset.
-    gpio_line_rst.set_value(0);
+    setPinReset(false);
     delay_ms(50);
-    gpio_line_rst.set_value(1);
+    setPinReset(true);
     delay_ms(50);
 }
 
@@ -192,6 +219,14 @@ void DisplayerST7735S::setOrientation(Orientation orientation)
     }
     // std::cout << "MADCTL: " << MADCTL << std::endl;
     setMADCTL();
+    invalidateFrame();
+}
+
+// Row/column exchange (MADCTL MV) swaps the panel axes
+void DisplayerST7735S::getSizeScreen(int& width, int& height) const
+{
+    width = MADCTL[5] ? screenHeight : screenWidth;
+    height = MADCTL[5] ? screenWidth : screenHeight;
 }
 
 // Offset start from Upper Left
@@ -199,8 +234,9 @@ void DisplayerST7735S::setArea(int width,
     int height, int offsetX, int offsetY)
 {
     // Limit: pixel count
-    int limitX = MADCTL[5] ? (screenHeight) : (screenWidth);
-    int limitY = MADCTL[5] ? (screenWidth) : (screenHeight);
+    int limitX = 0;
+    int limitY = 0;
+    getSizeScreen(limitX, limitY);
     uint8_t xS = 0, xE = 0, yS = 0, yE = 0;
     DisplayArea areaTarget{-1,-1};
     double ratioWHTarget = static_cast<double>(frameParSrc_.width)
@@ -358,11 +394,14 @@ void DisplayerST7735S::setArea(int width,
     xE = xS + areaTarget.width - 1;
     yE = yS + areaTarget.height - 1;
 
+    displayRange = {xS, xE, yS, yE};
+
     std::cout << "[ST7735S] Display area: " << areaTarget.width << " * " <<areaTarget.height 
         << "  X: " << std::dec << static_cast<int>(xS) << " ~ " << static_cast<int>(xE) 
         << "  Y: " << std::dec << static_cast<int>(yS) << " ~ " << static_cast<int>(yE) << std::endl;
 
     rangeSet(xS, xE, yS, yE);
+    windowIsArea_ = true;
 
     // // Temporary
     // uint16_t color = RGB888ToRGB565(0xFFFFFF);
@@ -388,27 +427,211 @@ bool DisplayerST7735S::syncFramePar()
     frameParDst_.pixFmt = pixFmt;
     frameParDst_.width = displayArea.width;
     frameParDst_.height = displayArea.height;
+    const size_t sizeTransfer = getNativeLayout().sizeTransfer();
+    worker_.start(std::max(config_.countBuffersTransmit.load(), 1),
+        [this](JobTransmit& job) { transmit(job); },
+        [sizeTransfer](JobTransmit& job) {
+            // Dirty rectangles never add up to more than the area
+            job.buffer.assign(sizeTransfer, 0);
+            job.regions.reserve(16);
+        });
+    std::cout << "[ST7735S] Transmit buffers: " 
+        << config_.countBuffersTransmit.load() 
+        << (worker_.isThreaded() ? " (async)" : " (sync)") << std::endl;
     return true;
 }
 
-void DisplayerST7735S::display(std::shared_ptr<AVFrame> frame)
+void DisplayerST7735S::display(std::shared_ptr<AVFrame> frame, uint64_t tag)
 {
-    const int bytesPerPixel = 
-        av_get_bits_per_pixel(av_pix_fmt_desc_get(frameParDst_.pixFmt)) / 8;
-    std::vector<uint8_t> buffer(frameParDst_.width * frameParDst_.height 
-        * bytesPerPixel);
-    if (frame->linesize[0] == frameParDst_.width * bytesPerPixel) {
-        std::memcpy(buffer.data(), frame->data[0], buffer.size());
+    if (frame->width != displayArea.width 
+        || frame->height != displayArea.height) {
+        std::cerr << "[ST7735S] Frame fail to match parameters" << std::endl;
+        failTransfer(tag);
+        return;
+    }
+    JobTransmit* job = worker_.acquire();
+    if (!job) {
+        failTransfer(tag);
+        return;
+    }
+    job->regions.clear();
+    job->transfer.tag = tag;
+    if (!diffFrame(frame.get())) {
+        prepareFull(frame, *job);
     } else {
-        for (int y = 0; y < frameParDst_.height; ++y) {
-            std::memcpy(
-                buffer.data() + y * frameParDst_.width * bytesPerPixel, 
+        size_t used = 0;
+        for (const auto& rect : rectsDirty_) {
+            prepareRect(frame, rect, *job, used);
+        }
+    }
+    // Unchanged frames are queued too: they are on the panel once the
+    // frames before them are
+    worker_.submit(job);
+    framePrev_ = std::move(frame);
+}
+
+void DisplayerST7735S::flush()
+{
+    worker_.drain();
+}
+
+void DisplayerST7735S::stopTransmit()
+{
+    worker_.stop();
+}
+
+FrameLayout DisplayerST7735S::getNativeLayout() const
+{
+    FrameLayout layout;
+    layout.pixFmt = pixFmt;
+    layout.width = displayArea.width;
+    layout.height = displayArea.height;
+    // RAMWR streams the window row after row without gaps
+    layout.stride = displayArea.width * bytesPerPixel;
+    layout.rows = displayArea.height;
+    layout.bigEndian = true;
+    return layout;
+}
+
+// Find the changed row bands against the previous frame
+// Returns false when a full write is cheaper (or there is nothing to diff)
+bool DisplayerST7735S::diffFrame(const AVFrame* frame)
+{
+    rectsDirty_.clear();
+    if (!framePrev_ || framePrev_->linesize[0] <= 0) {
+        return false;
+    }
+    const int bytesRow = displayArea.width * bytesPerPixel;
+    // First/last differing byte of a row, compared a word at a time
+    auto findFirst = [bytesRow](const uint8_t* a, const uint8_t* b) {
+        int i = 0;
+        for (uint64_t wa, wb; i + 8 <= bytesRow; i += 8) {
+            std::memcpy(&wa, a + i, 8);
+            std::memcpy(&wb, b + i, 8);
+            if (wa != wb) break;
+        }
+        while (a[i] == b[i]) i++;
+        return i;
+    };
+    auto findLast = [bytesRow](const uint8_t* a, const uint8_t* b) {
+        int i = bytesRow;
+        for (uint64_t wa, wb; i - 8 >= 0; i -= 8) {
+            std::memcpy(&wa, a + i - 8, 8);
+            std::memcpy(&wb, b + i - 8, 8);
+            if (wa != wb) break;
+        }
+        do { i--; } while (a[i] == b[i]);
+        return i;
+    };
+
+    long areaDirty = 0;
+    for (int y = 0; y < displayArea.height; ++y) {
+        const uint8_t* rowNew = frame->data[0] + y * frame->linesize[0];
+        const uint8_t* rowPrev = framePrev_->data[0] + y * framePrev_->linesize[0];
+        if (std::memcmp(rowNew, rowPrev, bytesRow) == 0) {
+            continue;
+        }
+        int xS = findFirst(rowNew, rowPrev) / bytesPerPixel;
+        int xE = findLast(rowNew, rowPrev) / bytesPerPixel;
+        if (!rectsDirty_.empty() 
+            && y - rectsDirty_.back().yE <= gapMergeRows) {
+            DirtyRect& rect = rectsDirty_.back();
+            areaDirty -= static_cast<long>(rect.width()) * rect.height();
+            rect.xS = std::min(rect.xS, xS);
+            rect.xE = std::max(rect.xE, xE);
+            rect.yE = y;
+        } else {
+            rectsDirty_.push_back({xS, xE, y, y});
+        }
+        areaDirty += static_cast<long>(rectsDirty_.back().width()) 
+            * rectsDirty_.back().height();
+        if (areaDirty > ratioDirtyMax * displayArea.width * displayArea.height) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void DisplayerST7735S::prepareFull(const std::shared_ptr<AVFrame>& frame, 
+    JobTransmit& job)
+{
+    const int bytesRow = displayArea.width * bytesPerPixel;
+    const size_t len = static_cast<size_t>(bytesRow) * displayArea.height;
+    const uint8_t* data = frame->data[0];
+    if (frame->linesize[0] == bytesRow) {
+        // Native layout: the frame itself goes on the wire
+        job.frame = frame;
+    } else {
+        // Close the row gaps first
+        for (int y = 0; y < displayArea.height; ++y) {
+            std::memcpy(job.buffer.data() + y * bytesRow, 
                 frame->data[0] + y * frame->linesize[0], 
-                frameParDst_.width * bytesPerPixel);
+                bytesRow);
         }
+        data = job.buffer.data();
     }
-    startWrite();
-    writeData(buffer.data(), buffer.size());
+    job.regions.push_back({
+        static_cast<uint8_t>(displayRange.xS), static_cast<uint8_t>(displayRange.xE), 
+        static_cast<uint8_t>(displayRange.yS), static_cast<uint8_t>(displayRange.yE), 
+        data, len});
+}
+
+void DisplayerST7735S::prepareRect(const std::shared_ptr<AVFrame>& frame, 
+    const DirtyRect& rect, JobTransmit& job, size_t& used)
+{
+    const int bytesRow = displayArea.width * bytesPerPixel;
+    const int bytesRect = rect.width() * bytesPerPixel;
+    const size_t len = static_cast<size_t>(bytesRect) * rect.height();
+    const uint8_t* data = frame->data[0] + rect.yS * frame->linesize[0] 
+        + rect.xS * bytesPerPixel;
+    if (bytesRect == bytesRow && frame->linesize[0] == bytesRow) {
+        job.frame = frame;
+    } else {
+        // Gather the rectangle rows into one contiguous block
+        uint8_t* gathered = job.buffer.data() + used;
+        for (int y = 0; y < rect.height(); ++y) {
+            std::memcpy(gathered + y * bytesRect, 
+                data + y * frame->linesize[0], 
+                bytesRect);
+        }
+        data = gathered;
+        used += len;
+    }
+    job.regions.push_back({
+        static_cast<uint8_t>(displayRange.xS + rect.xS), 
+        static_cast<uint8_t>(displayRange.xS + rect.xE), 
+        static_cast<uint8_t>(displayRange.yS + rect.yS), 
+        static_cast<uint8_t>(displayRange.yS + rect.yE), 
+        data, len});
+}
+
+void DisplayerST7735S::transmit(JobTransmit& job)
+{
+    beginTransfer(job.transfer);
+    if (job.regions.empty()) {
+        endTransfer(job.transfer);
+        job.frame.reset();
+        return;
+    }
+    const bool isArea = job.regions.size() == 1 
+        && job.regions[0].xS == displayRange.xS && job.regions[0].xE == displayRange.xE
+        && job.regions[0].yS == displayRange.yS && job.regions[0].yE == displayRange.yE;
+    beginFrameBus();
+    // Window, RAMWR and pixels of all regions in as few messages as
+    // possible; the frame and "job.buffer" outlive the batch
+    beginBatch();
+    for (const auto& region : job.regions) {
+        if (!(isArea && windowIsArea_)) {
+            setWindow(region.xS, region.xE, region.yS, region.yE);
+        }
+        startWrite();
+        writeData(region.data, region.len);
+    }
+    endBatch();
+    windowIsArea_ = isArea;
+    endFrameBus();
+    endTransfer(job.transfer);
+    job.frame.reset();
 }
 
 void DisplayerST7735S::fillWith(uint32_t color_rgb888)
@@ -452,18 +675,15 @@ void DisplayerST7735S::idleMode(bool on)
 
 void DisplayerST7735S::rangeSet(uint8_t xS, uint8_t xE, uint8_t yS, uint8_t yE)
 {
+    worker_.drain();
     delay_ms(10);
-    uint8_t xBuf[] = {0x00, xS, 0x00, xE};
-    uint8_t yBuf[] = {0x00, yS, 0x00, yE};
-    writeCmd(0x2A);
-    writeData(xBuf, sizeof(xBuf));
-    writeCmd(0x2B);
-    writeData(yBuf, sizeof(yBuf));
+    setWindow(xS, xE, yS, yE);
     delay_ms(10);
 }
 
 void DisplayerST7735S::rangeReset()
 {
+    invalidateFrame();
     MADCTL[5] ? 
         rangeSet(0,screenHeight-1,0,screenWidth-1) : 
         rangeSet(0,screenWidth-1,0,screenHeight-1);
@@ -477,28 +697,51 @@ uint16_t DisplayerST7735S::RGB888ToRGB565(uint32_t color)
     return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
 }
 
+bool DisplayerST7735S::openBus()
+{
+    return configure("/dev/spidev3.0", "gpiochip3", 10, "gpiochip3", 17);
+}
+
+void DisplayerST7735S::setPinReset(bool level)
+{
+#ifdef BPLAYER_HAS_GPIOD
+    gpio_line_rst.set_value(level ? 1 : 0);
+#endif
+}
+
 bool DisplayerST7735S::spiTransfer(bool isData, 
-    const uint8_t* data, size_t len)
-{
-    gpio_line_dc.set_value(isData ? 1 : 0);
-    struct spi_ioc_transfer tr = {
-        .tx_buf = (unsigned long)data,
-        .len = static_cast<unsigned int>(len),
-        .speed_hz = speed,
-        .delay_usecs = 0,
-        .bits_per_word = 8
-    };
-    if (ioctl(spi_fd, SPI_IOC_MESSAGE(1), &tr) < 0) {
+    const SpiSegment* segments, size_t count)
+{
+    // D/C is a GPIO write of its own, skip it while the level holds
+    if (levelDC_ != static_cast<int>(isData)) {
+#ifdef BPLAYER_HAS_GPIOD
+        gpio_line_dc.set_value(isData ? 1 : 0);
+#endif
+        levelDC_ = isData;
+    }
+    struct spi_ioc_transfer tr[MAX_SEGMENTS_MESSAGE];
+    std::memset(tr, 0, sizeof(tr[0]) * count);
+    size_t len = 0;
+    for (size_t i = 0; i < count; i++) {
+        tr[i].tx_buf = (unsigned long)segments[i].data;
+        tr[i].len = static_cast<unsigned int>(segments[i].len);
+        tr[i].speed_hz = speed;
+        tr[i].bits_per_word = 8;
+        len += segments[i].len;
+    }
+    // SPI_IOC_MESSAGE(count) with a run-time count
+    if (ioctl(spi_fd, _IOC(_IOC_WRITE, SPI_IOC_MAGIC, 0, SPI_MSGSIZE(count)), tr) < 0) {
         std::cerr << "[ST7735S] Failed: SPI transfer" 
             << std::endl;
         return false;
     }
+    countBus(len);
     return true;
 }
 
 bool DisplayerST7735S::writeCmd(uint8_t cmd)
 {
-    return spiTransfer(false, &cmd, 1);
+    return queueSegment(false, &cmd, 1);
 }
 
 bool DisplayerST7735S::writeData(uint8_t singleByte)
@@ -512,15 +755,91 @@ bool DisplayerST7735S::writeData(const uint8_t* data, size_t len)
         std::cerr 
             << "[ST7735S] Warning: Invalid data to display" 
             << std::endl;
+        return false;
     }
-    size_t offset = 0;
-    for (size_t offset = 0; offset < len; ) {
-        size_t chunkSize = std::min(maxSPIChunkSize, len - offset);
-        if (!spiTransfer(true, data + offset, chunkSize))
-            return false;
-        offset += chunkSize;
+    return queueSegment(true, data, len);
+}
+
+void DisplayerST7735S::beginBatch()
+{
+    depthBatch_++;
+}
+
+bool DisplayerST7735S::endBatch()
+{
+    if (depthBatch_ > 0 && --depthBatch_ > 0) {
+        return true;
     }
-    return true;
+    return flushQueued();
+}
+
+// Outside a batch every write is flushed at once, as its own transaction
+bool DisplayerST7735S::queueSegment(bool isData, const uint8_t* data, size_t len)
+{
+    if (len == 0) {
+        return true;
+    }
+    if (len <= MAX_SIZE_COPIED) {
+        // Command bytes and parameters often come from the stack; adjacent
+        // copies at the same level become one transfer
+        SegmentQueued* last = segmentsQueued_.empty() 
+            ? nullptr : &segmentsQueued_.back();
+        if (last && last->copied && last->isData == isData
+            && last->offset + last->len == bytesQueued_.size()) {
+            last->len += len;
+        } else {
+            segmentsQueued_.push_back({isData, true, bytesQueued_.size(), nullptr, len});
+        }
+        bytesQueued_.insert(bytesQueued_.end(), data, data + len);
+    } else {
+        segmentsQueued_.push_back({isData, false, 0, data, len});
+    }
+    return depthBatch_ > 0 ? true : flushQueued();
+}
+
+// Cut the queue into messages: at each D/C change, at "maxTransfer_"
+// bytes and at MAX_SEGMENTS_MESSAGE transfers
+bool DisplayerST7735S::flushQueued()
+{
+    bool ok = true;
+    size_t index = 0;
+    size_t consumed = 0;
+    while (ok && index < segmentsQueued_.size()) {
+        const bool isData = segmentsQueued_[index].isData;
+        size_t total = 0;
+        segmentsMessage_.clear();
+        while (index < segmentsQueued_.size() 
+            && segmentsQueued_[index].isData == isData
+            && segmentsMessage_.size() < MAX_SEGMENTS_MESSAGE
+            && total < maxTransfer_) {
+            const SegmentQueued& seg = segmentsQueued_[index];
+            const uint8_t* data = seg.copied 
+                ? bytesQueued_.data() + seg.offset : seg.data;
+            size_t take = std::min(seg.len - consumed, maxTransfer_ - total);
+            segmentsMessage_.push_back({data + consumed, take});
+            total += take;
+            consumed += take;
+            if (consumed == seg.len) {
+                index++;
+                consumed = 0;
+            }
+        }
+        ok = spiTransfer(isData, segmentsMessage_.data(), segmentsMessage_.size());
+    }
+    segmentsQueued_.clear();
+    bytesQueued_.clear();
+    return ok;
+}
+
+// The per-message limit of the spidev driver, a module parameter
+size_t DisplayerST7735S::readBufsizSpidev()
+{
+    std::ifstream file("/sys/module/spidev/parameters/bufsiz");
+    size_t bufsiz = 0;
+    if (file >> bufsiz && bufsiz > 0) {
+        return bufsiz;
+    }
+    return SIZE_TRANSFER_DEFAULT;
 }
 
 void DisplayerST7735S::delay_ms(uint64_t ms)
@@ -557,6 +876,26 @@ void DisplayerST7735S::startWrite()
     writeCmd(0x2C);
 }
 
+// Sleep-free CASET/RASET for the per-frame path
+void DisplayerST7735S::setWindow(uint8_t xS, uint8_t xE, uint8_t yS, uint8_t yE)
+{
+    uint8_t xBuf[] = {0x00, xS, 0x00, xE};
+    uint8_t yBuf[] = {0x00, yS, 0x00, yE};
+    writeCmd(0x2A);
+    writeData(xBuf, sizeof(xBuf));
+    writeCmd(0x2B);
+    writeData(yBuf, sizeof(yBuf));
+}
+
+// Panel content no longer matches the last frame, next one is sent whole
+void DisplayerST7735S::invalidateFrame()
+{
+    // The panel state changes under frames still waiting to be sent
+    worker_.drain();
+    framePrev_.reset();
+    windowIsArea_ = false;
+}
+
 void DisplayerST7735S::colorOrderRGB(bool RGB)
 {
     // RGB or BGR
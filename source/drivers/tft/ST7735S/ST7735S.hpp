@@ -1,6 +1,11 @@
+#pragma once
+
 #include "IDisplayer.hpp"
+#include "TransmitWorker.hpp"
 
+#ifdef BPLAYER_HAS_GPIOD
 #include "gpiod.hpp"
+#endif
 
 namespace bplayer
 {
@@ -10,6 +15,7 @@ public:
     const int screenWidth = 128;
     const int screenHeight = 160;
     const AVPixelFormat pixFmt = AV_PIX_FMT_RGB565BE;
+    const int bytesPerPixel = 2;
 
     explicit DisplayerST7735S(FrameParameter& frameParSrc, 
         FrameParameter& frameParDst,
@@ -27,8 +33,11 @@ public:
     void setOrientation(Orientation orientation) override;
     void setArea(int width = -1, int height = -1, 
         int offsetX = -1, int offsetY = -1) override;
+    void getSizeScreen(int& width, int& height) const override;
     bool syncFramePar() override;
-    void display(std::shared_ptr<AVFrame> frame) override;
+    void display(std::shared_ptr<AVFrame> frame, uint64_t tag) override;
+    void flush() override;
+    FrameLayout getNativeLayout() const override;
 
     void fillWith(uint32_t color_rgb888);
     void colorInversion(bool inversion);
@@ -38,27 +47,114 @@ public:
     void rangeSet(uint8_t xS, uint8_t xE, uint8_t yS, uint8_t yE);
     void rangeReset();
 
+protected:
+    uint32_t speed = 32000000;
+
+    // Part of an SPI message, sent back to back with the rest of it
+    struct SpiSegment {
+        const uint8_t* data;
+        size_t len;
+    };
+
+    // Hardware access, the only members touching SPI/GPIO.
+    // DisplayerST7735SVirtual replaces them with an emulated panel.
+    virtual bool openBus();
+    // One SPI message (one ioctl) of "count" segments at one D/C level
+    virtual bool spiTransfer(bool isData, const SpiSegment* segments, size_t count);
+    virtual void setPinReset(bool level);
+    virtual void delay_ms(uint64_t ms);
+    // Around the SPI messages of one frame, window commands included
+    virtual void beginFrameBus() {}
+    virtual void endFrameBus() {}
+    void stopTransmit();
+
 private:
+#ifdef BPLAYER_HAS_GPIOD
     gpiod::line gpio_line_rst;
     gpiod::line gpio_line_dc;
-    uint32_t speed = 32000000;
-    const size_t maxSPIChunkSize = 4096;
+#endif
+    // spidev default "bufsiz", the limit on the bytes of one message
+    static constexpr size_t SIZE_TRANSFER_DEFAULT = 4096;
+    // Transfers per message, far below what the ioctl size field allows
+    static constexpr size_t MAX_SEGMENTS_MESSAGE = 64;
+    // Shorter writes are copied into the queue, longer ones are referenced
+    static constexpr size_t MAX_SIZE_COPIED = 64;
+    // Partial update: fall back to a full write above this changed area
+    const double ratioDirtyMax = 0.6;
+    // Partial update: bands closer than this are sent as one window
+    const int gapMergeRows = 2;
     // Memory access control
     // D7 D6 D5 D4 D3  D2 D1 D0
     // MY MX MV ML RGB MH  x  x
     std::bitset<8> MADCTL = 0b00000000;
-    int spi_fd;
+    int spi_fd = -1;
     struct DisplayArea{int width; int height;} displayArea{-1, -1};
+    struct DisplayRange {
+        int xS, xE, yS, yE;
+    } displayRange{-1, -1, -1, -1};
+    // Changed rectangle of a partial update, relative to the display area
+    struct DirtyRect {
+        int xS, xE, yS, yE;
+        int width() const {return xE - xS + 1;}
+        int height() const {return yE - yS + 1;}
+    };
+    // One frame ready for the wire: windows in panel coordinates with
+    // their pixels, gathered into "buffer" or referenced from "frame"
+    struct JobTransmit {
+        struct Region {
+            uint8_t xS, xE, yS, yE;
+            const uint8_t* data;
+            size_t len;
+        };
+        std::vector<Region> regions;
+        std::vector<uint8_t> buffer;
+        std::shared_ptr<AVFrame> frame;
+        Transfer transfer;
+    };
+    // Last frame on the panel, reference kept for diffing
+    std::shared_ptr<AVFrame> framePrev_;
+    std::vector<DirtyRect> rectsDirty_;
+    bool windowIsArea_ = false;
+    // Segment waiting in the transaction queue, copied bytes are kept
+    // in "bytesQueued_" at "offset"
+    struct SegmentQueued {
+        bool isData;
+        bool copied;
+        size_t offset;
+        const uint8_t* data;
+        size_t len;
+    };
+    std::vector<SegmentQueued> segmentsQueued_;
+    std::vector<uint8_t> bytesQueued_;
+    std::vector<SpiSegment> segmentsMessage_;
+    int depthBatch_ = 0;
+    size_t maxTransfer_ = SIZE_TRANSFER_DEFAULT;
+    // Last level written to D/C, -1 = unknown
+    int levelDC_ = -1;
+    TransmitWorker<JobTransmit> worker_;
     
     uint16_t RGB888ToRGB565(uint32_t color);
-    bool spiTransfer(bool isData, const uint8_t* data, size_t len);
     bool writeCmd(uint8_t cmd);
     bool writeData(uint8_t singleByte);
     bool writeData(const uint8_t* data, size_t len);
-    void delay_ms(uint64_t ms);
+    // Writes between begin and end go out as few SPI messages as the D/C
+    // changes and "maxTransfer_" allow. Referenced data must stay valid
+    // until the end, and no delays may happen in between.
+    void beginBatch();
+    bool endBatch();
+    bool queueSegment(bool isData, const uint8_t* data, size_t len);
+    bool flushQueued();
+    static size_t readBufsizSpidev();
     void gammaCorrect();
     void setMADCTL();
     void startWrite();
+    void setWindow(uint8_t xS, uint8_t xE, uint8_t yS, uint8_t yE);
+    void invalidateFrame();
+    bool diffFrame(const AVFrame* frame);
+    void prepareFull(const std::shared_ptr<AVFrame>& frame, JobTransmit& job);
+    void prepareRect(const std::shared_ptr<AVFrame>& frame, const DirtyRect& rect, 
+        JobTransmit& job, size_t& used);
+    void transmit(JobTransmit& job);
     void colorOrderRGB(bool RGB);
 };
 
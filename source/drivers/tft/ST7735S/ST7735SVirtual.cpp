@@ -0,0 +1,235 @@
+#include "ST7735SVirtual.hpp"
+
+namespace bplayer
+{
+
+DisplayerST7735SVirtual::DisplayerST7735SVirtual(FrameParameter& frameParSrc,
+    FrameParameter& frameParDst,
+    PlayerConfig& config)
+    : DisplayerST7735S(frameParSrc, frameParDst, config),
+        bus_(speed, 8, 0, OVERHEAD_TRANSFER_NS),
+        gram_(static_cast<size_t>(screenWidth) * screenHeight, 0)
+{
+    resetController();
+}
+
+DisplayerST7735SVirtual::~DisplayerST7735SVirtual()
+{
+    stopTransmit();
+    VirtualBus::Stats stats = bus_.getStats();
+    std::cout << "[ST7735S Virtual] " << stats.frames << " frames, "
+        << stats.transactions << " transfers, " << stats.bytes << " bytes, wire "
+        << stats.wireNs / 1000000 << "ms, bus limit " << stats.fpsLimit()
+        << " fps @ " << speed << " Hz" << std::endl;
+}
+
+uint16_t DisplayerST7735SVirtual::getPixel(int x, int y) const
+{
+    int index = mapAddress(x, y);
+    return index < 0 ? 0 : gram_[index];
+}
+
+const std::vector<uint16_t>& DisplayerST7735SVirtual::getGram() const
+{
+    return gram_;
+}
+
+VirtualBus::Stats DisplayerST7735SVirtual::getStats() const
+{
+    return bus_.getStats();
+}
+
+bool DisplayerST7735SVirtual::openBus()
+{
+    if (config_.clockVirtualBusHz > 0) {
+        speed = config_.clockVirtualBusHz;
+    }
+    bus_.setClock(speed);
+    bus_.setRealtime(config_.realtimeVirtualBus);
+    bus_.reset();
+    resetController();
+    return true;
+}
+
+// A message pays the per-transfer overhead once, however many segments
+bool DisplayerST7735SVirtual::spiTransfer(bool isData,
+    const SpiSegment* segments, size_t count)
+{
+    size_t len = 0;
+    for (size_t s = 0; s < count; s++) {
+        for (size_t i = 0; i < segments[s].len; i++) {
+            if (isData) {
+                parameter(segments[s].data[i]);
+            } else {
+                command(segments[s].data[i]);
+            }
+        }
+        len += segments[s].len;
+    }
+    countBus(len, bus_.transfer(len));
+    return true;
+}
+
+void DisplayerST7735SVirtual::setPinReset(bool level)
+{
+    // Hardware reset acts on the falling edge
+    if (!level) {
+        resetController();
+    }
+}
+
+void DisplayerST7735SVirtual::delay_ms(uint64_t ms)
+{
+    bus_.delay(static_cast<int64_t>(ms) * 1000);
+}
+
+void DisplayerST7735SVirtual::beginFrameBus()
+{
+    bus_.beginFrame();
+}
+
+void DisplayerST7735SVirtual::endFrameBus()
+{
+    bus_.endFrame();
+}
+
+void DisplayerST7735SVirtual::resetController()
+{
+    cmd_ = 0;
+    countParams_ = 0;
+    madctl_ = 0;
+    colStart_ = 0;
+    colEnd_ = screenWidth - 1;
+    rowStart_ = 0;
+    rowEnd_ = screenHeight - 1;
+    col_ = 0;
+    row_ = 0;
+    bytesPixel_ = 3;
+    countPixel_ = 0;
+    inverted_ = false;
+    sleeping_ = true;
+    displayOn_ = false;
+}
+
+void DisplayerST7735SVirtual::command(uint8_t cmd)
+{
+    cmd_ = cmd;
+    countParams_ = 0;
+    switch (cmd) {
+    case CMD_SWRESET:
+        resetController();
+        break;
+    case CMD_SLPIN:
+        sleeping_ = true;
+        break;
+    case CMD_SLPOUT:
+        sleeping_ = false;
+        break;
+    case CMD_INVOFF:
+        inverted_ = false;
+        break;
+    case CMD_INVON:
+        inverted_ = true;
+        break;
+    case CMD_DISPOFF:
+        displayOn_ = false;
+        break;
+    case CMD_DISPON:
+        displayOn_ = true;
+        break;
+    case CMD_RAMWR:
+        col_ = colStart_;
+        row_ = rowStart_;
+        countPixel_ = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+void DisplayerST7735SVirtual::parameter(uint8_t value)
+{
+    if (cmd_ == CMD_RAMWR) {
+        pixel_[countPixel_++] = value;
+        if (countPixel_ < bytesPixel_) {
+            return;
+        }
+        countPixel_ = 0;
+        if (bytesPixel_ == 2) {
+            writePixel(static_cast<uint16_t>((pixel_[0] << 8) | pixel_[1]));
+        } else {
+            // RGB666 in the upper bits of each byte, stored as RGB565
+            writePixel(static_cast<uint16_t>(((pixel_[0] & 0xF8) << 8)
+                | ((pixel_[1] & 0xFC) << 3) | (pixel_[2] >> 3)));
+        }
+        return;
+    }
+    if (countParams_ < 4) {
+        params_[countParams_] = value;
+    }
+    countParams_++;
+    switch (cmd_) {
+    case CMD_CASET:
+        if (countParams_ == 4) {
+            colStart_ = (params_[0] << 8) | params_[1];
+            colEnd_ = (params_[2] << 8) | params_[3];
+        }
+        break;
+    case CMD_RASET:
+        if (countParams_ == 4) {
+            rowStart_ = (params_[0] << 8) | params_[1];
+            rowEnd_ = (params_[2] << 8) | params_[3];
+        }
+        break;
+    case CMD_MADCTL:
+        if (countParams_ == 1) {
+            madctl_ = value;
+        }
+        break;
+    case CMD_COLMOD:
+        if (countParams_ == 1) {
+            // IFPF: 3 = 12 bit, 5 = 16 bit, 6 = 18 bit; 12 bit is not emulated
+            bytesPixel_ = (value & 0x07) == 0x05 ? 2 : 3;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Write at the pointer, then advance column first, wrapping in the window
+void DisplayerST7735SVirtual::writePixel(uint16_t color)
+{
+    int index = mapAddress(col_, row_);
+    if (index >= 0) {
+        gram_[index] = color;
+    }
+    if (++col_ > colEnd_) {
+        col_ = colStart_;
+        if (++row_ > rowEnd_) {
+            row_ = rowStart_;
+        }
+    }
+}
+
+// MADCTL D7 MY mirrors rows, D6 MX mirrors columns, D5 MV exchanges them
+int DisplayerST7735SVirtual::mapAddress(int col, int row) const
+{
+    bool my = madctl_ & 0x80;
+    bool mx = madctl_ & 0x40;
+    bool mv = madctl_ & 0x20;
+    int x = mv ? row : col;
+    int y = mv ? col : row;
+    if (x < 0 || x >= screenWidth || y < 0 || y >= screenHeight) {
+        return -1;
+    }
+    if (mx) {
+        x = screenWidth - 1 - x;
+    }
+    if (my) {
+        y = screenHeight - 1 - y;
+    }
+    return y * screenWidth + x;
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "ST7735S.hpp"
+#include "VirtualBus.hpp"
+
+namespace bplayer
+{
+
+// ST7735S driver running against an emulated controller
+// Everything above the SPI transfer is the real driver. The byte stream
+// is decoded like the controller does (CASET/RASET/RAMWR/MADCTL/COLMOD)
+// into a 128x160 RGB565 GRAM, and every transfer is charged its wire
+// time at the driver's SPI clock.
+class DisplayerST7735SVirtual : public DisplayerST7735S {
+public:
+    explicit DisplayerST7735SVirtual(FrameParameter& frameParSrc,
+        FrameParameter& frameParDst,
+        PlayerConfig& config);
+    ~DisplayerST7735SVirtual();
+
+    // Pixel as seen through the current MADCTL, like a RAMWR would write it
+    uint16_t getPixel(int x, int y) const;
+    // GRAM in physical order, screenWidth x screenHeight
+    const std::vector<uint16_t>& getGram() const;
+    VirtualBus::Stats getStats() const;
+
+protected:
+    bool openBus() override;
+    bool spiTransfer(bool isData, const SpiSegment* segments, size_t count) override;
+    void setPinReset(bool level) override;
+    void delay_ms(uint64_t ms) override;
+    void beginFrameBus() override;
+    void endFrameBus() override;
+
+private:
+    // ioctl and chip select around each message
+    static constexpr int64_t OVERHEAD_TRANSFER_NS = 5000;
+
+    static constexpr uint8_t CMD_SWRESET = 0x01;
+    static constexpr uint8_t CMD_SLPIN = 0x10;
+    static constexpr uint8_t CMD_SLPOUT = 0x11;
+    static constexpr uint8_t CMD_INVOFF = 0x20;
+    static constexpr uint8_t CMD_INVON = 0x21;
+    static constexpr uint8_t CMD_DISPOFF = 0x28;
+    static constexpr uint8_t CMD_DISPON = 0x29;
+    static constexpr uint8_t CMD_CASET = 0x2A;
+    static constexpr uint8_t CMD_RASET = 0x2B;
+    static constexpr uint8_t CMD_RAMWR = 0x2C;
+    static constexpr uint8_t CMD_MADCTL = 0x36;
+    static constexpr uint8_t CMD_COLMOD = 0x3A;
+
+    VirtualBus bus_;
+    std::vector<uint16_t> gram_;
+
+    uint8_t cmd_ = 0;
+    uint8_t params_[4] = {0};
+    int countParams_ = 0;
+    // Address window and write pointer, in MADCTL (logical) coordinates
+    int colStart_ = 0;
+    int colEnd_ = 0;
+    int rowStart_ = 0;
+    int rowEnd_ = 0;
+    int col_ = 0;
+    int row_ = 0;
+    uint8_t madctl_ = 0;
+    // Bytes per pixel from COLMOD, 2 (RGB565) or 3 (RGB666)
+    int bytesPixel_ = 3;
+    uint8_t pixel_[3] = {0};
+    int countPixel_ = 0;
+    bool inverted_ = false;
+    bool sleeping_ = true;
+    bool displayOn_ = false;
+
+    void resetController();
+    void command(uint8_t cmd);
+    void parameter(uint8_t value);
+    void writePixel(uint16_t color);
+    // Logical coordinates to GRAM index, -1 outside the panel
+    int mapAddress(int col, int row) const;
+};
+
+}
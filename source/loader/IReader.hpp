@@ -0,0 +1,24 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace bplayer
+{
+
+// Byte source behind the custom AVIOContext of the Loader
+class IReader {
+public:
+    virtual ~IReader() = default;
+
+    virtual bool open(const std::string& path) = 0;
+    virtual void close() = 0;
+    // Bytes copied, 0 at the end of the file, negative errno on failure
+    virtual int read(uint8_t* buf, int size) = 0;
+    // Absolute position afterwards, negative errno on failure
+    virtual int64_t seek(int64_t offset) = 0;
+    virtual int64_t size() const = 0;
+    virtual int64_t position() const = 0;
+    virtual const char* getName() const = 0;
+};
+
+}
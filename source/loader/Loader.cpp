@@ -1,16 +1,26 @@
 #include "Loader.hpp"
 
+#include "ReaderAhead.hpp"
+#include "ReaderFile.hpp"
+#include "ReaderMmap.hpp"
+#include "ReaderUring.hpp"
+#include "Timer.hpp"
+
 namespace bplayer {
 
-Loader::Loader(AVFormatContext*& ctxFormat)
-    :ctxFormat_(ctxFormat)
+Loader::Loader(AVFormatContext*& ctxFormat, PlayerConfig& config, Telemetry& telemetry,
+    ProbeCache& probeCache)
+    :ctxFormat_(ctxFormat),
+        config_(config),
+        telemetry_(telemetry),
+        probeCache_(probeCache)
 {
 
 }
 
 Loader::~Loader()
 {
-
+    closeIo();
 }
 
 bool Loader::open(const std::string& path)
@@ -19,16 +29,62 @@ bool Loader::open(const std::string& path)
         std::cerr << "[Loader] Format context exist already" << std::endl;
         return false;
     }
+    closeIo();
+    probeCache_.reset();
     
-    int ret = avformat_open_input(&ctxFormat_, path.c_str(), nullptr, nullptr);
+    // "lavfi:<graph>" opens a synthetic libavfilter source
+    const AVInputFormat* format = nullptr;
+    std::string url = path;
+    if (path.compare(0, PREFIX_LAVFI.size(), PREFIX_LAVFI) == 0) {
+        avdevice_register_all();
+        format = av_find_input_format("lavfi");
+        if (!format) {
+            std::cerr << "[Loader] lavfi input is not available" << std::endl;
+            return false;
+        }
+        url = path.substr(PREFIX_LAVFI.size());
+    } else if (isLocalFile(path)) {
+        if (path.compare(0, PREFIX_FILE.size(), PREFIX_FILE) == 0) {
+            url = path.substr(PREFIX_FILE.size());
+        }
+        if (config_.probeCache != ProbeCacheMode::Off) {
+            probeCache_.load(url);
+        }
+        // The file protocol still works if the custom reader does not
+        if (openIo(url)) {
+            ctxFormat_ = avformat_alloc_context();
+            if (!ctxFormat_) {
+                closeIo();
+                return false;
+            }
+            ctxFormat_->pb = ctxIo_;
+            ctxFormat_->flags |= AVFMT_FLAG_CUSTOM_IO;
+        } else {
+            url = path;
+        }
+    }
+
+    // Frees the context it was given on failure
+    int ret = avformat_open_input(&ctxFormat_, url.c_str(), format, nullptr);
     
     if (ret < 0) {
         char errBuf[256];
         av_strerror(ret, errBuf, sizeof(errBuf));
         std::cerr << "[Loader] Failed to open file: " << errBuf << std::endl;
+        closeIo();
         return false;
     }
 
+    const bool cached = probeCache_.apply(ctxFormat_);
+    if (cached) {
+        if (config_.probeCache == ProbeCacheMode::Skip) {
+            std::cout << "[Loader] Stream info from the probe cache" << std::endl;
+            return true;
+        }
+        ctxFormat_->probesize = PROBESIZE_CACHED;
+        ctxFormat_->max_analyze_duration = ANALYZE_CACHED_US;
+    }
+
     ret = avformat_find_stream_info(ctxFormat_, nullptr);
     if (ret < 0) {
         char errBuf[256];
@@ -36,8 +92,118 @@ bool Loader::open(const std::string& path)
         std::cerr << "[Loader] Failed to find stream info: " << errBuf << std::endl;
         return false;
     }
+    // A short probe knows less than the one in the cache, keep that
+    if (!cached) {
+        probeCache_.store(ctxFormat_);
+    }
     
     return true;
 }
 
-}
\ No newline at end of file
+// Plain paths and "file:" URLs, anything else names a protocol
+bool Loader::isLocalFile(const std::string& path)
+{
+    if (path.compare(0, PREFIX_FILE.size(), PREFIX_FILE) == 0) {
+        return true;
+    }
+    return path.find("://") == std::string::npos;
+}
+
+std::unique_ptr<IReader> Loader::createReader() const
+{
+    const int64_t sizeRing = config_.sizeRingReadAhead;
+    std::unique_ptr<IReader> reader;
+    switch (config_.readerInput.load()) {
+    case ReaderInput::Uring:
+        return std::make_unique<ReaderUring>(config_.countReadsUring.load(), 
+            config_.sizeBlockUring.load());
+    case ReaderInput::Mmap:
+        reader = std::make_unique<ReaderMmap>(config_.sizeReadAhead.load());
+        break;
+    case ReaderInput::Default:
+    default:
+        // The ring needs a reader of its own underneath
+        if (sizeRing > 0) {
+            reader = std::make_unique<ReaderFile>();
+        }
+        break;
+    }
+    if (reader && sizeRing > 0) {
+        reader = std::make_unique<ReaderAhead>(std::move(reader), sizeRing);
+    }
+    return reader;
+}
+
+bool Loader::openIo(const std::string& path)
+{
+    reader_ = createReader();
+    if (!reader_) {
+        return false;
+    }
+    if (!reader_->open(path)) {
+        std::cerr << "[Loader] " << reader_->getName() 
+            << " reader failed, using the file protocol" << std::endl;
+        reader_.reset();
+        return false;
+    }
+    const int sizeBuffer = std::max(config_.sizeBufferIo.load(), SIZE_BUFFER_IO_MIN);
+    uint8_t* buffer = static_cast<uint8_t*>(av_malloc(sizeBuffer));
+    if (buffer) {
+        ctxIo_ = avio_alloc_context(buffer, sizeBuffer, 0, this, 
+            &Loader::readPacket, nullptr, &Loader::seekPacket);
+    }
+    if (!ctxIo_) {
+        av_freep(&buffer);
+        reader_.reset();
+        return false;
+    }
+    std::cout << "[Loader] " << reader_->getName() << " reader, " 
+        << reader_->size() << " bytes, IO buffer " << sizeBuffer << std::endl;
+    return true;
+}
+
+void Loader::closeIo()
+{
+    if (ctxIo_) {
+        // The demuxer may have swapped the buffer for a larger one
+        av_freep(&ctxIo_->buffer);
+        avio_context_free(&ctxIo_);
+    }
+    reader_.reset();
+}
+
+int Loader::readPacket(void* opaque, uint8_t* buf, int size)
+{
+    Loader* loader = static_cast<Loader*>(opaque);
+    const int64_t begin = Timer::nowUs();
+    const int ret = loader->reader_->read(buf, size);
+    loader->telemetry_.stage(Stage::Demuxer).stallIoUs.fetch_add(
+        Timer::nowUs() - begin, std::memory_order_relaxed);
+    if (ret == 0) {
+        return AVERROR_EOF;
+    }
+    return ret < 0 ? AVERROR(-ret) : ret;
+}
+
+int64_t Loader::seekPacket(void* opaque, int64_t offset, int whence)
+{
+    IReader* reader = static_cast<Loader*>(opaque)->reader_.get();
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return reader->size();
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        offset += reader->position();
+        break;
+    case SEEK_END:
+        offset += reader->size();
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    const int64_t ret = reader->seek(offset);
+    return ret < 0 ? AVERROR(-ret) : ret;
+}
+
+}
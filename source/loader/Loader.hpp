@@ -2,18 +2,45 @@
 
 #include "common.hpp"
 #include "ffmpeg.hpp"
+#include "IReader.hpp"
+#include "ProbeCache.hpp"
+#include "Telemetry.hpp"
 
 namespace bplayer {
 
 class Loader {
 public:
-    Loader(AVFormatContext*& ctxFormat);
+    Loader(AVFormatContext*& ctxFormat, PlayerConfig& config, Telemetry& telemetry,
+        ProbeCache& probeCache);
     ~Loader();
 
     bool open(const std::string& path);
 
 private:
+    inline static const std::string PREFIX_LAVFI = "lavfi:";
+    inline static const std::string PREFIX_FILE = "file:";
+    static constexpr int SIZE_BUFFER_IO_MIN = 4096;
+    // Probing left with ProbeCacheMode::Limit
+    static constexpr int64_t PROBESIZE_CACHED = 32 * 1024;
+    static constexpr int64_t ANALYZE_CACHED_US = 100000;
+
     AVFormatContext*& ctxFormat_;
+    PlayerConfig& config_;
+    Telemetry& telemetry_;
+    ProbeCache& probeCache_;
+
+    // Custom IO, outlives the format context (avformat_close_input leaves
+    // a caller owned pb alone)
+    std::unique_ptr<IReader> reader_;
+    AVIOContext* ctxIo_ = nullptr;
+
+    static bool isLocalFile(const std::string& path);
+    std::unique_ptr<IReader> createReader() const;
+    bool openIo(const std::string& path);
+    void closeIo();
+
+    static int readPacket(void* opaque, uint8_t* buf, int size);
+    static int64_t seekPacket(void* opaque, int64_t offset, int whence);
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,501 @@
+#include "ProbeCache.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace bplayer
+{
+
+// Native byte order: an entry never leaves the machine that wrote it
+struct BufferOut {
+    std::string data;
+
+    template<typename T>
+    void put(T value) {
+        data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void putString(const std::string& value) {
+        put<uint32_t>(static_cast<uint32_t>(value.size()));
+        data.append(value);
+    }
+    void putRational(AVRational value) {
+        put<int32_t>(value.num);
+        put<int32_t>(value.den);
+    }
+};
+
+struct BufferIn {
+    const std::string& data;
+    size_t offset = 0;
+    bool ok = true;
+
+    template<typename T>
+    T get() {
+        T value{};
+        if (!ok || data.size() - offset < sizeof(value)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    }
+    std::string getString() {
+        const uint32_t size = get<uint32_t>();
+        if (!ok || data.size() - offset < size) {
+            ok = false;
+            return std::string();
+        }
+        std::string value = data.substr(offset, size);
+        offset += size;
+        return value;
+    }
+    AVRational getRational() {
+        AVRational value;
+        value.num = get<int32_t>();
+        value.den = get<int32_t>();
+        return value;
+    }
+};
+
+ProbeCache::ProbeCache()
+{
+
+}
+
+ProbeCache::~ProbeCache()
+{
+
+}
+
+bool ProbeCache::load(const std::string& path)
+{
+    reset();
+    if (!readKey(path, key_)) {
+        return false;
+    }
+    const std::string directory = getDirectory();
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.probe", 
+        static_cast<unsigned long long>(hashFnv(key_.path.data(), key_.path.size())));
+    pathEntry_ = directory + name;
+    active_ = true;
+    probed_ = readEntry() && entry_.key == key_;
+    if (!probed_) {
+        entry_ = Entry();
+        entry_.key = key_;
+    }
+    return probed_;
+}
+
+void ProbeCache::reset()
+{
+    active_ = false;
+    probed_ = false;
+    dirty_ = false;
+    key_ = Key();
+    entry_ = Entry();
+    pathEntry_.clear();
+}
+
+bool ProbeCache::apply(AVFormatContext* ctxFormat) const
+{
+    if (!probed_ || !ctxFormat->iformat || !ctxFormat->iformat->name
+        || entry_.format != ctxFormat->iformat->name
+        || entry_.streams.size() != ctxFormat->nb_streams) {
+        return false;
+    }
+    // The header alone may leave a codec open (raw and TS streams), but
+    // never names a different one
+    for (unsigned int i = 0; i < ctxFormat->nb_streams; i++) {
+        const AVCodecParameters* par = ctxFormat->streams[i]->codecpar;
+        const Stream& cached = entry_.streams[i];
+        if ((par->codec_type != AVMEDIA_TYPE_UNKNOWN && par->codec_type != cached.codecType)
+            || (par->codec_id != AV_CODEC_ID_NONE && par->codec_id != cached.codecId)) {
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < ctxFormat->nb_streams; i++) {
+        AVStream* stream = ctxFormat->streams[i];
+        AVCodecParameters* par = stream->codecpar;
+        const Stream& cached = entry_.streams[i];
+        par->codec_type = cached.codecType;
+        par->codec_id = cached.codecId;
+        par->codec_tag = cached.codecTag;
+        par->format = cached.format;
+        par->bit_rate = cached.bitRate;
+        par->bits_per_coded_sample = cached.bitsPerCodedSample;
+        par->bits_per_raw_sample = cached.bitsPerRawSample;
+        par->profile = cached.profile;
+        par->level = cached.level;
+        par->width = cached.width;
+        par->height = cached.height;
+        par->sample_aspect_ratio = cached.sar;
+        par->field_order = static_cast<AVFieldOrder>(cached.fieldOrder);
+        par->color_range = static_cast<AVColorRange>(cached.colorRange);
+        par->color_primaries = static_cast<AVColorPrimaries>(cached.colorPrimaries);
+        par->color_trc = static_cast<AVColorTransferCharacteristic>(cached.colorTrc);
+        par->color_space = static_cast<AVColorSpace>(cached.colorSpace);
+        par->chroma_location = static_cast<AVChromaLocation>(cached.chromaLocation);
+        par->video_delay = cached.videoDelay;
+        par->sample_rate = cached.sampleRate;
+        if (!cached.extradata.empty()) {
+            uint8_t* extradata = static_cast<uint8_t*>(
+                av_mallocz(cached.extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (!extradata) {
+                return false;
+            }
+            std::memcpy(extradata, cached.extradata.data(), cached.extradata.size());
+            av_freep(&par->extradata);
+            par->extradata = extradata;
+            par->extradata_size = static_cast<int>(cached.extradata.size());
+        }
+        stream->avg_frame_rate = cached.avgFrameRate;
+        stream->r_frame_rate = cached.rFrameRate;
+        stream->duration = cached.duration;
+        stream->start_time = cached.startTime;
+        stream->nb_frames = cached.countFrames;
+    }
+    ctxFormat->duration = entry_.duration;
+    ctxFormat->start_time = entry_.startTime;
+    ctxFormat->bit_rate = entry_.bitRate;
+    return true;
+}
+
+void ProbeCache::store(const AVFormatContext* ctxFormat)
+{
+    if (!active_ || !ctxFormat->iformat || !ctxFormat->iformat->name) {
+        return;
+    }
+    entry_ = Entry();
+    entry_.key = key_;
+    entry_.format = ctxFormat->iformat->name;
+    entry_.duration = ctxFormat->duration;
+    entry_.startTime = ctxFormat->start_time;
+    entry_.bitRate = ctxFormat->bit_rate;
+    for (unsigned int i = 0; i < ctxFormat->nb_streams; i++) {
+        const AVStream* stream = ctxFormat->streams[i];
+        const AVCodecParameters* par = stream->codecpar;
+        Stream cached;
+        cached.codecType = par->codec_type;
+        cached.codecId = par->codec_id;
+        cached.codecTag = par->codec_tag;
+        cached.format = par->format;
+        cached.bitRate = par->bit_rate;
+        cached.bitsPerCodedSample = par->bits_per_coded_sample;
+        cached.bitsPerRawSample = par->bits_per_raw_sample;
+        cached.profile = par->profile;
+        cached.level = par->level;
+        cached.width = par->width;
+        cached.height = par->height;
+        cached.sar = par->sample_aspect_ratio;
+        cached.fieldOrder = par->field_order;
+        cached.colorRange = par->color_range;
+        cached.colorPrimaries = par->color_primaries;
+        cached.colorTrc = par->color_trc;
+        cached.colorSpace = par->color_space;
+        cached.chromaLocation = par->chroma_location;
+        cached.videoDelay = par->video_delay;
+        cached.sampleRate = par->sample_rate;
+        cached.avgFrameRate = stream->avg_frame_rate;
+        cached.rFrameRate = stream->r_frame_rate;
+        cached.duration = stream->duration;
+        cached.startTime = stream->start_time;
+        cached.countFrames = stream->nb_frames;
+        if (par->extradata && par->extradata_size > 0) {
+            cached.extradata.assign(reinterpret_cast<const char*>(par->extradata), 
+                par->extradata_size);
+        }
+        entry_.streams.push_back(std::move(cached));
+    }
+    probed_ = true;
+    dirty_ = true;
+}
+
+bool ProbeCache::getScore(int widthTarget, int heightTarget, Score& score) const
+{
+    if (!probed_ || !entry_.hasScore || entry_.score.widthTarget != widthTarget
+        || entry_.score.heightTarget != heightTarget) {
+        return false;
+    }
+    score = entry_.score;
+    return true;
+}
+
+void ProbeCache::setScore(const Score& score)
+{
+    if (!probed_ || (entry_.hasScore && entry_.score == score)) {
+        return;
+    }
+    entry_.hasScore = true;
+    entry_.score = score;
+    dirty_ = true;
+}
+
+bool ProbeCache::getKeyframes(int indexStream, KeyframeIndex& index) const
+{
+    if (!probed_ || entry_.indexStreamKeyframes != indexStream || entry_.keyframes.empty()) {
+        return false;
+    }
+    index.assign(entry_.keyframes, entry_.covered);
+    return true;
+}
+
+void ProbeCache::setKeyframes(int indexStream, const KeyframeIndex& index)
+{
+    if (!probed_) {
+        return;
+    }
+    entry_.indexStreamKeyframes = indexStream;
+    entry_.keyframes = index.getEntries();
+    entry_.covered = index.getCovered();
+    dirty_ = true;
+}
+
+void ProbeCache::save()
+{
+    if (!active_ || !probed_ || !dirty_) {
+        return;
+    }
+    writeEntry();
+    dirty_ = false;
+}
+
+// $XDG_CACHE_HOME/bplayer, ~/.cache/bplayer, else under /tmp
+std::string ProbeCache::getDirectory()
+{
+    const char* cache = getenv("XDG_CACHE_HOME");
+    if (cache && cache[0] == '/') {
+        return std::string(cache) + "/bplayer";
+    }
+    const char* home = getenv("HOME");
+    if (home && home[0] == '/') {
+        return std::string(home) + "/.cache/bplayer";
+    }
+    return "/tmp/bplayer-cache";
+}
+
+bool ProbeCache::makeDirectories(const std::string& path)
+{
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+        if (pos == path.size() || path[pos] == '/') {
+            const std::string part = path.substr(0, pos);
+            if (mkdir(part.c_str(), 0755) < 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// FNV-1a, 64 bit
+uint64_t ProbeCache::hashFnv(const void* data, size_t size, uint64_t hash)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bool ProbeCache::readKey(const std::string& path, Key& key)
+{
+    char resolved[PATH_MAX];
+    if (!realpath(path.c_str(), resolved)) {
+        return false;
+    }
+    const int fd = ::open(resolved, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    std::vector<uint8_t> header(SIZE_HEADER);
+    ssize_t size;
+    do {
+        size = pread(fd, header.data(), header.size(), 0);
+    } while (size < 0 && errno == EINTR);
+    ::close(fd);
+    if (size < 0) {
+        return false;
+    }
+    key.path = resolved;
+    key.size = st.st_size;
+    key.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    key.hashHeader = hashFnv(header.data(), static_cast<size_t>(size));
+    return true;
+}
+
+bool ProbeCache::readEntry()
+{
+    std::ifstream file(pathEntry_, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)), 
+        std::istreambuf_iterator<char>());
+    BufferIn in{data};
+    if (in.get<uint32_t>() != MAGIC || in.get<uint32_t>() != VERSION) {
+        return false;
+    }
+    Entry entry;
+    entry.key.path = in.getString();
+    entry.key.size = in.get<int64_t>();
+    entry.key.mtimeNs = in.get<int64_t>();
+    entry.key.hashHeader = in.get<uint64_t>();
+    entry.format = in.getString();
+    entry.duration = in.get<int64_t>();
+    entry.startTime = in.get<int64_t>();
+    entry.bitRate = in.get<int64_t>();
+    const uint32_t countStreams = in.get<uint32_t>();
+    for (uint32_t i = 0; in.ok && i < countStreams; i++) {
+        Stream stream;
+        stream.codecType = static_cast<AVMediaType>(in.get<int32_t>());
+        stream.codecId = static_cast<AVCodecID>(in.get<int32_t>());
+        stream.codecTag = in.get<uint32_t>();
+        stream.format = in.get<int32_t>();
+        stream.bitRate = in.get<int64_t>();
+        stream.bitsPerCodedSample = in.get<int32_t>();
+        stream.bitsPerRawSample = in.get<int32_t>();
+        stream.profile = in.get<int32_t>();
+        stream.level = in.get<int32_t>();
+        stream.width = in.get<int32_t>();
+        stream.height = in.get<int32_t>();
+        stream.sar = in.getRational();
+        stream.fieldOrder = in.get<int32_t>();
+        stream.colorRange = in.get<int32_t>();
+        stream.colorPrimaries = in.get<int32_t>();
+        stream.colorTrc = in.get<int32_t>();
+        stream.colorSpace = in.get<int32_t>();
+        stream.chromaLocation = in.get<int32_t>();
+        stream.videoDelay = in.get<int32_t>();
+        stream.sampleRate = in.get<int32_t>();
+        stream.avgFrameRate = in.getRational();
+        stream.rFrameRate = in.getRational();
+        stream.duration = in.get<int64_t>();
+        stream.startTime = in.get<int64_t>();
+        stream.countFrames = in.get<int64_t>();
+        stream.extradata = in.getString();
+        entry.streams.push_back(std::move(stream));
+    }
+    entry.hasScore = in.get<uint8_t>() != 0;
+    entry.score.widthTarget = in.get<int32_t>();
+    entry.score.heightTarget = in.get<int32_t>();
+    entry.score.indexVideo = in.get<int32_t>();
+    entry.score.indexAudio = in.get<int32_t>();
+    entry.score.indexSubtitle = in.get<int32_t>();
+    entry.indexStreamKeyframes = in.get<int32_t>();
+    const uint32_t countKeyframes = in.get<uint32_t>();
+    for (uint32_t i = 0; in.ok && i < countKeyframes; i++) {
+        KeyframeIndex::Entry keyframe;
+        keyframe.ptsUs = in.get<int64_t>();
+        keyframe.pos = in.get<int64_t>();
+        entry.keyframes.push_back(keyframe);
+    }
+    const uint32_t countCovered = in.get<uint32_t>();
+    for (uint32_t i = 0; in.ok && i < countCovered; i++) {
+        const int64_t begin = in.get<int64_t>();
+        const int64_t end = in.get<int64_t>();
+        entry.covered.emplace_back(begin, end);
+    }
+    if (!in.ok) {
+        std::cerr << "[ProbeCache] Ignoring truncated entry " << pathEntry_ << std::endl;
+        return false;
+    }
+    entry_ = std::move(entry);
+    return true;
+}
+
+void ProbeCache::writeEntry() const
+{
+    BufferOut out;
+    out.put<uint32_t>(MAGIC);
+    out.put<uint32_t>(VERSION);
+    out.putString(entry_.key.path);
+    out.put<int64_t>(entry_.key.size);
+    out.put<int64_t>(entry_.key.mtimeNs);
+    out.put<uint64_t>(entry_.key.hashHeader);
+    out.putString(entry_.format);
+    out.put<int64_t>(entry_.duration);
+    out.put<int64_t>(entry_.startTime);
+    out.put<int64_t>(entry_.bitRate);
+    out.put<uint32_t>(static_cast<uint32_t>(entry_.streams.size()));
+    for (const Stream& stream : entry_.streams) {
+        out.put<int32_t>(stream.codecType);
+        out.put<int32_t>(stream.codecId);
+        out.put<uint32_t>(stream.codecTag);
+        out.put<int32_t>(stream.format);
+        out.put<int64_t>(stream.bitRate);
+        out.put<int32_t>(stream.bitsPerCodedSample);
+        out.put<int32_t>(stream.bitsPerRawSample);
+        out.put<int32_t>(stream.profile);
+        out.put<int32_t>(stream.level);
+        out.put<int32_t>(stream.width);
+        out.put<int32_t>(stream.height);
+        out.putRational(stream.sar);
+        out.put<int32_t>(stream.fieldOrder);
+        out.put<int32_t>(stream.colorRange);
+        out.put<int32_t>(stream.colorPrimaries);
+        out.put<int32_t>(stream.colorTrc);
+        out.put<int32_t>(stream.colorSpace);
+        out.put<int32_t>(stream.chromaLocation);
+        out.put<int32_t>(stream.videoDelay);
+        out.put<int32_t>(stream.sampleRate);
+        out.putRational(stream.avgFrameRate);
+        out.putRational(stream.rFrameRate);
+        out.put<int64_t>(stream.duration);
+        out.put<int64_t>(stream.startTime);
+        out.put<int64_t>(stream.countFrames);
+        out.putString(stream.extradata);
+    }
+    out.put<uint8_t>(entry_.hasScore ? 1 : 0);
+    out.put<int32_t>(entry_.score.widthTarget);
+    out.put<int32_t>(entry_.score.heightTarget);
+    out.put<int32_t>(entry_.score.indexVideo);
+    out.put<int32_t>(entry_.score.indexAudio);
+    out.put<int32_t>(entry_.score.indexSubtitle);
+    out.put<int32_t>(entry_.indexStreamKeyframes);
+    out.put<uint32_t>(static_cast<uint32_t>(entry_.keyframes.size()));
+    for (const KeyframeIndex::Entry& keyframe : entry_.keyframes) {
+        out.put<int64_t>(keyframe.ptsUs);
+        out.put<int64_t>(keyframe.pos);
+    }
+    out.put<uint32_t>(static_cast<uint32_t>(entry_.covered.size()));
+    for (const auto& interval : entry_.covered) {
+        out.put<int64_t>(interval.first);
+        out.put<int64_t>(interval.second);
+    }
+
+    const size_t slash = pathEntry_.rfind('/');
+    if (slash == std::string::npos || !makeDirectories(pathEntry_.substr(0, slash))) {
+        std::cerr << "[ProbeCache] Cannot create the cache directory for " 
+            << pathEntry_ << std::endl;
+        return;
+    }
+    // Written aside and renamed: a reader never sees half an entry
+    const std::string pathTemp = pathEntry_ + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(pathTemp, std::ios::binary | std::ios::trunc);
+        file.write(out.data.data(), static_cast<std::streamsize>(out.data.size()));
+        if (!file) {
+            std::cerr << "[ProbeCache] Failed to write " << pathTemp << std::endl;
+            unlink(pathTemp.c_str());
+            return;
+        }
+    }
+    if (rename(pathTemp.c_str(), pathEntry_.c_str()) < 0) {
+        unlink(pathTemp.c_str());
+    }
+}
+
+}
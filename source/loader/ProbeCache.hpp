@@ -0,0 +1,134 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+#include "KeyframeIndex.hpp"
+
+namespace bplayer
+{
+
+// Results of avformat_find_stream_info(), of the stream scoring and the
+// keyframe index of the demuxer kept on disk, one file per media file
+// An entry is keyed by the canonical path, size, mtime and a hash of the
+// first bytes of the file; any change of those is a miss. On a hit the
+// Loader restores the probed codec parameters and frame rates into the
+// freshly opened context and skips or shortens the probing, the way
+// ffplay -find_stream_info 0 opens, but with the probe's knowledge.
+class ProbeCache {
+public:
+    // Stream choice of Demuxer::init for one target size
+    struct Score {
+        int widthTarget = -1;
+        int heightTarget = -1;
+        int indexVideo = -1;
+        int indexAudio = -1;
+        int indexSubtitle = -1;
+
+        bool operator==(const Score& other) const {
+            return widthTarget == other.widthTarget && heightTarget == other.heightTarget
+                && indexVideo == other.indexVideo && indexAudio == other.indexAudio
+                && indexSubtitle == other.indexSubtitle;
+        }
+    };
+
+    ProbeCache();
+    ~ProbeCache();
+
+    // Keys the file and reads its entry; false on a miss or a stale entry
+    // (store() then writes a new one)
+    bool load(const std::string& path);
+    // Nothing keyed: the next getScore()/setScore()/store() do nothing
+    void reset();
+    // Restores the probe into a context just opened on the loaded file,
+    // false if its header does not match the entry
+    bool apply(AVFormatContext* ctxFormat) const;
+    // Records the probe of the loaded file; like setScore() and
+    // setKeyframes() it only changes the entry in memory, see save()
+    void store(const AVFormatContext* ctxFormat);
+    bool getScore(int widthTarget, int heightTarget, Score& score) const;
+    void setScore(const Score& score);
+    bool getKeyframes(int indexStream, KeyframeIndex& index) const;
+    void setKeyframes(int indexStream, const KeyframeIndex& index);
+    // Writes the entry if it changed since it was loaded or saved; one
+    // write per open instead of one per change, off the opening path
+    void save();
+
+private:
+    static constexpr uint32_t MAGIC = 0x43505042; // "BPPC"
+    static constexpr uint32_t VERSION = 2;
+    // Hashed part of the file, holds the container header of most formats
+    static constexpr size_t SIZE_HEADER = 64 * 1024;
+
+    struct Stream {
+        AVMediaType codecType = AVMEDIA_TYPE_UNKNOWN;
+        AVCodecID codecId = AV_CODEC_ID_NONE;
+        uint32_t codecTag = 0;
+        int format = -1;
+        int64_t bitRate = 0;
+        int bitsPerCodedSample = 0;
+        int bitsPerRawSample = 0;
+        int profile = 0;
+        int level = 0;
+        int width = 0;
+        int height = 0;
+        AVRational sar{0, 1};
+        int fieldOrder = 0;
+        int colorRange = 0;
+        int colorPrimaries = 0;
+        int colorTrc = 0;
+        int colorSpace = 0;
+        int chromaLocation = 0;
+        int videoDelay = 0;
+        int sampleRate = 0;
+        AVRational avgFrameRate{0, 1};
+        AVRational rFrameRate{0, 1};
+        int64_t duration = 0;
+        int64_t startTime = 0;
+        int64_t countFrames = 0;
+        std::string extradata;
+    };
+
+    struct Key {
+        std::string path;
+        int64_t size = 0;
+        int64_t mtimeNs = 0;
+        uint64_t hashHeader = 0;
+
+        bool operator==(const Key& other) const {
+            return path == other.path && size == other.size 
+                && mtimeNs == other.mtimeNs && hashHeader == other.hashHeader;
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::string format;
+        int64_t duration = 0;
+        int64_t startTime = 0;
+        int64_t bitRate = 0;
+        std::vector<Stream> streams;
+        bool hasScore = false;
+        Score score;
+        int indexStreamKeyframes = -1;
+        std::vector<KeyframeIndex::Entry> keyframes;
+        std::vector<std::pair<int64_t, int64_t>> covered;
+    };
+
+    bool active_ = false;
+    bool probed_ = false;
+    // Entry changed in memory, not written yet
+    bool dirty_ = false;
+    Key key_;
+    Entry entry_;
+    std::string pathEntry_;
+
+    static std::string getDirectory();
+    static bool makeDirectories(const std::string& path);
+    static uint64_t hashFnv(const void* data, size_t size, 
+        uint64_t hash = 0xcbf29ce484222325ULL);
+    static bool readKey(const std::string& path, Key& key);
+    bool readEntry();
+    void writeEntry() const;
+};
+
+}
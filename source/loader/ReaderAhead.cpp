@@ -0,0 +1,148 @@
+#include "ReaderAhead.hpp"
+
+#include <cerrno>
+
+namespace bplayer
+{
+
+ReaderAhead::ReaderAhead(std::unique_ptr<IReader> inner, int64_t sizeRing)
+    : inner_(std::move(inner)),
+        ring_(static_cast<size_t>(std::max(sizeRing, SIZE_RING_MIN))),
+        name_(std::string(inner_->getName()) + " + read-ahead")
+{
+
+}
+
+ReaderAhead::~ReaderAhead()
+{
+    close();
+}
+
+bool ReaderAhead::open(const std::string& path)
+{
+    close();
+    if (!inner_->open(path)) {
+        return false;
+    }
+    start_ = 0;
+    begin_ = 0;
+    end_ = 0;
+    fill_ = 0;
+    eof_ = false;
+    error_ = 0;
+    running_ = true;
+    thread_ = std::thread(&ReaderAhead::run, this);
+    return true;
+}
+
+void ReaderAhead::close()
+{
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cvFill_.notify_one();
+        cvData_.notify_all();
+        thread_.join();
+    }
+    inner_->close();
+}
+
+int ReaderAhead::read(uint8_t* buf, int size)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cvData_.wait(lock, [&]() {
+        return !running_ || end_ > begin_ || eof_ || error_ != 0;
+    });
+    if (!running_) {
+        return -EBADF;
+    }
+    if (end_ <= begin_) {
+        return error_;
+    }
+    // One contiguous piece, AVIOContext asks again for the rest; the
+    // thread never writes at or after begin_ - sizeBehind() + sizeRing()
+    const int64_t index = begin_ % sizeRing();
+    const int count = static_cast<int>(std::min({static_cast<int64_t>(size), 
+        end_ - begin_, sizeRing() - index}));
+    lock.unlock();
+    std::memcpy(buf, ring_.data() + index, count);
+    lock.lock();
+    begin_ += count;
+    lock.unlock();
+    cvFill_.notify_one();
+    return count;
+}
+
+int64_t ReaderAhead::seek(int64_t offset)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return -EBADF;
+        }
+        if (offset < 0) {
+            return -EINVAL;
+        }
+        if (offset >= std::max(start_, fill_ - sizeRing()) && offset <= end_) {
+            begin_ = offset;
+        } else {
+            generation_++;
+            start_ = offset;
+            begin_ = offset;
+            end_ = offset;
+            eof_ = false;
+            error_ = 0;
+        }
+    }
+    cvFill_.notify_one();
+    return offset;
+}
+
+void ReaderAhead::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cvFill_.wait(lock, [&]() {
+            return !running_ || (!eof_ && error_ == 0 && room() > 0);
+        });
+        if (!running_) {
+            break;
+        }
+        const uint64_t generation = generation_;
+        const int64_t from = end_;
+        const int64_t index = from % sizeRing();
+        const int64_t span = std::min({SIZE_CHUNK, sizeRing() - index, room()});
+        fill_ = from + span;
+        lock.unlock();
+
+        // Slow storage blocks here, not in the demuxer
+        int ret = 0;
+        if (inner_->position() != from) {
+            const int64_t pos = inner_->seek(from);
+            ret = pos < 0 ? static_cast<int>(pos) : 0;
+        }
+        if (ret == 0) {
+            ret = inner_->read(ring_.data() + index, static_cast<int>(span));
+        }
+
+        lock.lock();
+        fill_ = end_;
+        if (generation != generation_) {
+            continue;
+        }
+        if (ret > 0) {
+            end_ += ret;
+            fill_ = end_;
+            start_ = std::max(start_, end_ - sizeRing());
+        } else if (ret == 0) {
+            eof_ = true;
+        } else {
+            error_ = ret;
+        }
+        cvData_.notify_one();
+    }
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "common.hpp"
+#include "IReader.hpp"
+
+namespace bplayer
+{
+
+// Read-ahead ring over another reader
+// A thread keeps the ring filled ahead of the demuxer with large reads
+// from the inner reader, so storage stalls (SD cards take hundreds of ms
+// now and then) hit that thread while the demuxer is served from memory.
+// The ring is addressed by file offset: offset o lives at o % capacity.
+// A seek inside the buffered window only moves the read position, any
+// other seek invalidates the window and refills from the new offset.
+// read()/seek() belong to one consumer thread.
+class ReaderAhead : public IReader {
+public:
+    ReaderAhead(std::unique_ptr<IReader> inner, int64_t sizeRing);
+    ~ReaderAhead() override;
+
+    bool open(const std::string& path) override;
+    void close() override;
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t offset) override;
+    int64_t size() const override { return inner_->size(); }
+    int64_t position() const override { return begin_; }
+    const char* getName() const override { return name_.c_str(); }
+
+private:
+    // One read of the inner reader
+    static constexpr int64_t SIZE_CHUNK = 256 * 1024;
+    static constexpr int64_t SIZE_RING_MIN = 4 * SIZE_CHUNK;
+    // Part of the ring kept behind the read position, probing reads seek
+    // back a little
+    static constexpr int DIVISOR_BEHIND = 8;
+
+    std::unique_ptr<IReader> inner_;
+    std::vector<uint8_t> ring_;
+    const std::string name_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cvFill_;
+    std::condition_variable cvData_;
+    bool running_ = false;
+    // Window of valid data: [start_, end_), begin_ is the read position
+    int64_t start_ = 0;
+    int64_t begin_ = 0;
+    int64_t end_ = 0;
+    // End of the range the thread is reading into right now (end_ when
+    // idle), the ring slots it overwrites are gone already
+    int64_t fill_ = 0;
+    // Bumped by a seek, fills of an older window are dropped
+    uint64_t generation_ = 0;
+    bool eof_ = false;
+    // Negative errno of the inner reader
+    int error_ = 0;
+
+    int64_t sizeRing() const { return static_cast<int64_t>(ring_.size()); }
+    int64_t sizeBehind() const { return sizeRing() / DIVISOR_BEHIND; }
+    // Free space ahead of end_, call with the mutex held
+    int64_t room() const { return begin_ - sizeBehind() + sizeRing() - end_; }
+    void run();
+};
+
+}
@@ -0,0 +1,81 @@
+#include "ReaderFile.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace bplayer
+{
+
+ReaderFile::ReaderFile()
+{
+
+}
+
+ReaderFile::~ReaderFile()
+{
+    close();
+}
+
+bool ReaderFile::open(const std::string& path)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        std::cerr << "[ReaderFile] Failed to open " << path << ": " 
+            << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) < 0 || !S_ISREG(st.st_mode)) {
+        std::cerr << "[ReaderFile] Not a regular file: " << path << std::endl;
+        close();
+        return false;
+    }
+    size_ = st.st_size;
+    position_ = 0;
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+void ReaderFile::close()
+{
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    position_ = 0;
+}
+
+int ReaderFile::read(uint8_t* buf, int size)
+{
+    if (fd_ < 0) {
+        return -EBADF;
+    }
+    ssize_t ret;
+    do {
+        ret = ::read(fd_, buf, static_cast<size_t>(size));
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -errno;
+    }
+    position_ += ret;
+    return static_cast<int>(ret);
+}
+
+int64_t ReaderFile::seek(int64_t offset)
+{
+    if (fd_ < 0) {
+        return -EBADF;
+    }
+    const off_t ret = lseek(fd_, static_cast<off_t>(offset), SEEK_SET);
+    if (ret < 0) {
+        return -errno;
+    }
+    position_ = ret;
+    return position_;
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.hpp"
+#include "IReader.hpp"
+
+namespace bplayer
+{
+
+// Plain read()/lseek() on a file descriptor, the source under the
+// read-ahead ring when the file is not mapped
+class ReaderFile : public IReader {
+public:
+    ReaderFile();
+    ~ReaderFile() override;
+
+    bool open(const std::string& path) override;
+    void close() override;
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t offset) override;
+    int64_t size() const override { return size_; }
+    int64_t position() const override { return position_; }
+    const char* getName() const override { return "file"; }
+
+private:
+    int fd_ = -1;
+    int64_t size_ = 0;
+    int64_t position_ = 0;
+};
+
+}
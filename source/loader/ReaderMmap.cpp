@@ -0,0 +1,128 @@
+#include "ReaderMmap.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace bplayer
+{
+
+ReaderMmap::ReaderMmap(int64_t sizeReadAhead)
+    : sizeReadAhead_(sizeReadAhead)
+{
+
+}
+
+ReaderMmap::~ReaderMmap()
+{
+    close();
+}
+
+bool ReaderMmap::open(const std::string& path)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        std::cerr << "[ReaderMmap] Failed to open " << path << ": " 
+            << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        std::cerr << "[ReaderMmap] Not a regular, non empty file: " << path << std::endl;
+        close();
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "[ReaderMmap] Failed to map " << path << ": " 
+            << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = st.st_size;
+    position_ = 0;
+    endAdvised_ = 0;
+    const long sizePage = sysconf(_SC_PAGESIZE);
+    if (sizePage > 0) {
+        sizePage_ = sizePage;
+    }
+    // Doubles the kernel readahead and drops pages behind us sooner
+    madvise(const_cast<uint8_t*>(data_), static_cast<size_t>(size_), MADV_SEQUENTIAL);
+    advise(0);
+    return true;
+}
+
+void ReaderMmap::close()
+{
+    if (data_) {
+        munmap(const_cast<uint8_t*>(data_), static_cast<size_t>(size_));
+        data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    position_ = 0;
+    endAdvised_ = 0;
+}
+
+int ReaderMmap::read(uint8_t* buf, int size)
+{
+    if (!data_) {
+        return -EBADF;
+    }
+    const int64_t left = size_ - position_;
+    if (left <= 0) {
+        return 0;
+    }
+    const int count = static_cast<int>(std::min<int64_t>(size, left));
+    std::memcpy(buf, data_ + position_, count);
+    position_ += count;
+    // Slide the window once half of it is consumed, the next faults then
+    // find their pages already on the way
+    if (endAdvised_ - position_ < sizeReadAhead_ / 2) {
+        advise(position_);
+    }
+    return count;
+}
+
+int64_t ReaderMmap::seek(int64_t offset)
+{
+    if (!data_) {
+        return -EBADF;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    // Past the end is allowed, read() reports the end; the window only
+    // restarts when the jump leaves it (probing seeks back and forth)
+    position_ = offset;
+    if (position_ > endAdvised_ || position_ + sizeReadAhead_ < endAdvised_) {
+        endAdvised_ = 0;
+        advise(std::min(position_, size_));
+    }
+    return position_;
+}
+
+void ReaderMmap::advise(int64_t from)
+{
+    if (sizeReadAhead_ <= 0) {
+        return;
+    }
+    // madvise wants a page aligned start, skip what was asked for already
+    int64_t begin = std::max(from, endAdvised_);
+    begin -= begin % sizePage_;
+    const int64_t end = std::min(from + sizeReadAhead_, size_);
+    if (end <= begin) {
+        return;
+    }
+    madvise(const_cast<uint8_t*>(data_) + begin, static_cast<size_t>(end - begin), MADV_WILLNEED);
+    endAdvised_ = end;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.hpp"
+#include "IReader.hpp"
+
+namespace bplayer
+{
+
+// Maps the whole file and copies straight out of the page cache: no
+// read() per buffer, and the kernel is told where playback goes next
+// (sequential access, a WILLNEED window ahead of the position)
+class ReaderMmap : public IReader {
+public:
+    explicit ReaderMmap(int64_t sizeReadAhead);
+    ~ReaderMmap() override;
+
+    bool open(const std::string& path) override;
+    void close() override;
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t offset) override;
+    int64_t size() const override { return size_; }
+    int64_t position() const override { return position_; }
+    const char* getName() const override { return "mmap"; }
+
+private:
+    const int64_t sizeReadAhead_;
+
+    int fd_ = -1;
+    const uint8_t* data_ = nullptr;
+    int64_t size_ = 0;
+    int64_t position_ = 0;
+    // End of the range already handed to MADV_WILLNEED
+    int64_t endAdvised_ = 0;
+    int64_t sizePage_ = 4096;
+
+    void advise(int64_t from);
+};
+
+}
@@ -0,0 +1,342 @@
+#include "ReaderUring.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// Kernel headers older than io_uring build a reader that never opens
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define BPLAYER_HAS_URING 1
+#else
+#define BPLAYER_HAS_URING 0
+#endif
+
+namespace bplayer
+{
+
+ReaderUring::ReaderUring(int depth, int sizeBlock)
+    : depth_(std::clamp(depth, 1, DEPTH_MAX)),
+        sizeBlock_(std::max(sizeBlock, SIZE_BLOCK_MIN))
+{
+
+}
+
+ReaderUring::~ReaderUring()
+{
+    close();
+}
+
+bool ReaderUring::open(const std::string& path)
+{
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        std::cerr << "[ReaderUring] Failed to open " << path << ": " 
+            << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) < 0 || !S_ISREG(st.st_mode)) {
+        std::cerr << "[ReaderUring] Not a regular file: " << path << std::endl;
+        close();
+        return false;
+    }
+    size_ = st.st_size;
+    position_ = 0;
+    if (!setupRings()) {
+        close();
+        return false;
+    }
+    slots_.assign(depth_, Slot{});
+    countQueued_ = 0;
+    return true;
+}
+
+void ReaderUring::close()
+{
+#if BPLAYER_HAS_URING
+    // The kernel writes into the buffers until the reads complete
+    while (rings_.fd >= 0 && std::any_of(slots_.begin(), slots_.end(), 
+        [](const Slot& slot) { return slot.state == StateSlot::InFlight; })) {
+        if (enter(true) < 0) {
+            break;
+        }
+        reap();
+    }
+#endif
+    closeRings();
+    slots_.clear();
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    position_ = 0;
+}
+
+int ReaderUring::read(uint8_t* buf, int size)
+{
+    if (fd_ < 0 || rings_.fd < 0) {
+        return -EBADF;
+    }
+    if (position_ >= size_) {
+        return 0;
+    }
+    const int64_t block = position_ / sizeBlock_;
+    Slot& slot = slots_[block % depth_];
+    while (true) {
+        reap();
+        fill(block);
+        if (slot.block == block && slot.state == StateSlot::Done) {
+            break;
+        }
+        const int ret = enter(true);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    // What fill() queued for the blocks ahead
+    if (countQueued_ > 0) {
+        enter(false);
+    }
+    if (slot.result < 0) {
+        // Retried with the next read
+        const int error = slot.result;
+        slot = Slot{};
+        return error;
+    }
+    const int64_t available = slot.result - (position_ - block * sizeBlock_);
+    if (available <= 0) {
+        // Short read inside the file: it shrank under us
+        slot = Slot{};
+        return -EIO;
+    }
+    const int count = static_cast<int>(std::min<int64_t>(size, available));
+    std::memcpy(buf, buffer(block % depth_) + (position_ - block * sizeBlock_), count);
+    position_ += count;
+    return count;
+}
+
+int64_t ReaderUring::seek(int64_t offset)
+{
+    if (fd_ < 0) {
+        return -EBADF;
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    position_ = offset;
+    return position_;
+}
+
+#if BPLAYER_HAS_URING
+
+bool ReaderUring::setupRings()
+{
+    io_uring_params params{};
+    rings_.fd = static_cast<int>(syscall(__NR_io_uring_setup, depth_, &params));
+    if (rings_.fd < 0) {
+        std::cerr << "[ReaderUring] io_uring is not available: " 
+            << std::strerror(errno) << std::endl;
+        return false;
+    }
+    rings_.sizeSq = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    rings_.sizeCq = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        rings_.sizeSq = std::max(rings_.sizeSq, rings_.sizeCq);
+        rings_.sizeCq = rings_.sizeSq;
+    }
+    rings_.sq = mmap(nullptr, rings_.sizeSq, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, rings_.fd, IORING_OFF_SQ_RING);
+    if (rings_.sq == MAP_FAILED) {
+        rings_.sq = nullptr;
+        return false;
+    }
+    if (single) {
+        rings_.cq = rings_.sq;
+    } else {
+        rings_.cq = mmap(nullptr, rings_.sizeCq, PROT_READ | PROT_WRITE, 
+            MAP_SHARED | MAP_POPULATE, rings_.fd, IORING_OFF_CQ_RING);
+        if (rings_.cq == MAP_FAILED) {
+            rings_.cq = nullptr;
+            return false;
+        }
+    }
+    rings_.sizeSqes = params.sq_entries * sizeof(io_uring_sqe);
+    rings_.sqes = mmap(nullptr, rings_.sizeSqes, PROT_READ | PROT_WRITE, 
+        MAP_SHARED | MAP_POPULATE, rings_.fd, IORING_OFF_SQES);
+    if (rings_.sqes == MAP_FAILED) {
+        rings_.sqes = nullptr;
+        return false;
+    }
+    uint8_t* sq = static_cast<uint8_t*>(rings_.sq);
+    uint8_t* cq = static_cast<uint8_t*>(rings_.cq);
+    rings_.sqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    rings_.sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    rings_.sqMask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    rings_.sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    rings_.cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    rings_.cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    rings_.cqMask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    rings_.cqes = cq + params.cq_off.cqes;
+
+    // Registered once: the kernel keeps the pages pinned and mapped
+    // instead of looking them up for every read
+    const size_t sizeBuffers = static_cast<size_t>(depth_) * sizeBlock_;
+    void* buffers = nullptr;
+    if (posix_memalign(&buffers, static_cast<size_t>(sysconf(_SC_PAGESIZE)), sizeBuffers) != 0) {
+        return false;
+    }
+    buffers_ = static_cast<uint8_t*>(buffers);
+    std::vector<iovec> iovecs(depth_);
+    for (int i = 0; i < depth_; i++) {
+        iovecs[i].iov_base = buffer(i);
+        iovecs[i].iov_len = static_cast<size_t>(sizeBlock_);
+    }
+    if (syscall(__NR_io_uring_register, rings_.fd, IORING_REGISTER_BUFFERS, 
+        iovecs.data(), depth_) < 0) {
+        std::cerr << "[ReaderUring] Failed to register the buffers: " 
+            << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ReaderUring::closeRings()
+{
+    if (rings_.sqes) {
+        munmap(rings_.sqes, rings_.sizeSqes);
+    }
+    if (rings_.cq && rings_.cq != rings_.sq) {
+        munmap(rings_.cq, rings_.sizeCq);
+    }
+    if (rings_.sq) {
+        munmap(rings_.sq, rings_.sizeSq);
+    }
+    // Also drops the buffer registration
+    if (rings_.fd >= 0) {
+        ::close(rings_.fd);
+    }
+    rings_ = Rings{};
+    free(buffers_);
+    buffers_ = nullptr;
+}
+
+void ReaderUring::fill(int64_t block)
+{
+    for (int i = 0; i < depth_; i++) {
+        const int64_t next = block + i;
+        if (next * sizeBlock_ >= size_) {
+            break;
+        }
+        const int index = static_cast<int>(next % depth_);
+        const Slot& slot = slots_[index];
+        if ((slot.block == next && slot.state != StateSlot::Idle)
+            || slot.state == StateSlot::InFlight) {
+            // Ready or on the way; or the buffer is busy with an older block
+            continue;
+        }
+        if (!queueRead(index, next)) {
+            break;
+        }
+    }
+}
+
+bool ReaderUring::queueRead(int slot, int64_t block)
+{
+    const uint32_t tail = *rings_.sqTail;
+    const uint32_t head = __atomic_load_n(rings_.sqHead, __ATOMIC_ACQUIRE);
+    if (tail - head > *rings_.sqMask) {
+        return false;
+    }
+    const uint32_t index = tail & *rings_.sqMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(rings_.sqes) + index;
+    const int64_t offset = block * sizeBlock_;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd_;
+    sqe->off = static_cast<uint64_t>(offset);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer(slot));
+    sqe->len = static_cast<uint32_t>(std::min<int64_t>(sizeBlock_, size_ - offset));
+    sqe->buf_index = static_cast<uint16_t>(slot);
+    sqe->user_data = static_cast<uint64_t>(slot);
+    rings_.sqArray[index] = index;
+    __atomic_store_n(rings_.sqTail, tail + 1, __ATOMIC_RELEASE);
+    slots_[slot].block = block;
+    slots_[slot].state = StateSlot::InFlight;
+    countQueued_++;
+    return true;
+}
+
+int ReaderUring::enter(bool wait)
+{
+    long ret;
+    do {
+        ret = syscall(__NR_io_uring_enter, rings_.fd, countQueued_, wait ? 1 : 0, 
+            wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        return -errno;
+    }
+    countQueued_ -= std::min<uint32_t>(countQueued_, static_cast<uint32_t>(ret));
+    return 0;
+}
+
+void ReaderUring::reap()
+{
+    uint32_t head = *rings_.cqHead;
+    const uint32_t tail = __atomic_load_n(rings_.cqTail, __ATOMIC_ACQUIRE);
+    const io_uring_cqe* cqes = static_cast<const io_uring_cqe*>(rings_.cqes);
+    while (head != tail) {
+        const io_uring_cqe& cqe = cqes[head & *rings_.cqMask];
+        Slot& slot = slots_[static_cast<size_t>(cqe.user_data)];
+        slot.state = StateSlot::Done;
+        slot.result = cqe.res;
+        head++;
+    }
+    __atomic_store_n(rings_.cqHead, head, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool ReaderUring::setupRings()
+{
+    std::cerr << "[ReaderUring] Built without io_uring headers" << std::endl;
+    return false;
+}
+
+void ReaderUring::closeRings()
+{
+
+}
+
+void ReaderUring::fill(int64_t block)
+{
+
+}
+
+bool ReaderUring::queueRead(int slot, int64_t block)
+{
+    return false;
+}
+
+int ReaderUring::enter(bool wait)
+{
+    return -ENOSYS;
+}
+
+void ReaderUring::reap()
+{
+
+}
+
+#endif
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "common.hpp"
+#include "IReader.hpp"
+
+namespace bplayer
+{
+
+// Reads through io_uring, without liburing (raw syscalls)
+// The file is cut into blocks; the block under the read position and the
+// ones after it, up to "depth" of them, are kept in flight as fixed
+// buffer reads, so flash storage sees a deep queue and no thread sits in
+// a blocking read. Slot i only ever holds blocks with number % depth == i:
+// a seek needs no bookkeeping, the slots retarget as reads come in.
+// open() fails when the kernel has no usable io_uring (too old, disabled
+// by sysctl or seccomp) and the Loader falls back to the file protocol.
+class ReaderUring : public IReader {
+public:
+    ReaderUring(int depth, int sizeBlock);
+    ~ReaderUring() override;
+
+    bool open(const std::string& path) override;
+    void close() override;
+    int read(uint8_t* buf, int size) override;
+    int64_t seek(int64_t offset) override;
+    int64_t size() const override { return size_; }
+    int64_t position() const override { return position_; }
+    const char* getName() const override { return "io_uring"; }
+
+private:
+    static constexpr int DEPTH_MAX = 64;
+    static constexpr int SIZE_BLOCK_MIN = 16 * 1024;
+
+    enum class StateSlot {
+        Idle,
+        InFlight,
+        Done
+    };
+
+    struct Slot {
+        int64_t block = -1;
+        StateSlot state = StateSlot::Idle;
+        // Bytes read or negative errno, valid when Done
+        int result = 0;
+    };
+
+    // The mapped parts of the rings the kernel shares with us
+    struct Rings {
+        int fd = -1;
+        void* sq = nullptr;
+        size_t sizeSq = 0;
+        void* cq = nullptr;
+        size_t sizeCq = 0;
+        void* sqes = nullptr;
+        size_t sizeSqes = 0;
+        uint32_t* sqHead = nullptr;
+        uint32_t* sqTail = nullptr;
+        uint32_t* sqMask = nullptr;
+        uint32_t* sqArray = nullptr;
+        uint32_t* cqHead = nullptr;
+        uint32_t* cqTail = nullptr;
+        uint32_t* cqMask = nullptr;
+        void* cqes = nullptr;
+    };
+
+    const int depth_;
+    const int sizeBlock_;
+
+    int fd_ = -1;
+    int64_t size_ = 0;
+    int64_t position_ = 0;
+    Rings rings_;
+    uint8_t* buffers_ = nullptr;
+    std::vector<Slot> slots_;
+    // Queued in the submission ring, not yet handed to the kernel
+    uint32_t countQueued_ = 0;
+
+    bool setupRings();
+    void closeRings();
+    // Queues reads for the block at "block" and the ones after it
+    void fill(int64_t block);
+    bool queueRead(int slot, int64_t block);
+    // Submits what is queued and, if asked, waits for one completion
+    int enter(bool wait);
+    void reap();
+    uint8_t* buffer(int slot) const {
+        return buffers_ + static_cast<size_t>(slot) * sizeBlock_;
+    }
+};
+
+}
@@ -0,0 +1,93 @@
+#include "FramePool.hpp"
+
+namespace bplayer
+{
+
+FramePool::FramePool()
+{
+
+}
+
+FramePool::~FramePool()
+{
+    reset();
+}
+
+bool FramePool::init(size_t count, int width, int height, AVPixelFormat pixFmt, 
+    Allocator allocator)
+{
+    reset();
+    if (count == 0 || width <= 0 || height <= 0) {
+        std::cerr << "[Frame Pool] Invalid pool parameters" << std::endl;
+        return false;
+    }
+    frames_.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        auto frame = make_avframe();
+        if (!frame) {
+            std::cerr << "[Frame Pool] Failed to allocate frame" << std::endl;
+            reset();
+            return false;
+        }
+        frame->width = width;
+        frame->height = height;
+        frame->format = pixFmt;
+        if (allocator) {
+            if (!allocator(frame.get())) {
+                std::cerr << "[Frame Pool] Failed to attach image buffer" << std::endl;
+                reset();
+                return false;
+            }
+            frames_.push_back(std::move(frame));
+            continue;
+        }
+        // Refcounted buffer, released together with the frame
+        int ret = av_frame_get_buffer(frame.get(), ALIGN_BUFFER);
+        if (ret < 0) {
+            std::cerr << "[Frame Pool] Failed to allocate image buffer: " 
+                << ffmpegErrStr(ret) << std::endl;
+            reset();
+            return false;
+        }
+        frames_.push_back(std::move(frame));
+    }
+    return true;
+}
+
+void FramePool::reset()
+{
+    frames_.clear();
+    indexNext_ = 0;
+}
+
+std::shared_ptr<AVFrame> FramePool::acquire(const std::atomic<bool>& running)
+{
+    if (frames_.empty()) {
+        return nullptr;
+    }
+    while (running.load()) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (size_t n = 0; n < frames_.size(); n++) {
+            size_t i = (indexNext_ + n) % frames_.size();
+            // Only the pool holds it: nobody can take a new reference now
+            if (frames_[i].use_count() == 1) {
+                // Order the last user's release before our writes
+                std::atomic_thread_fence(std::memory_order_acquire);
+                indexNext_ = (i + 1) % frames_.size();
+                return frames_[i];
+            }
+        }
+        lock.unlock();
+        // Pool is sized to the queue depth, this only happens when a
+        // consumer holds on to frames longer than expected
+        std::this_thread::sleep_for(std::chrono::microseconds(INTERVAL_RETRY_US));
+    }
+    return nullptr;
+}
+
+size_t FramePool::size() const
+{
+    return frames_.size();
+}
+
+}
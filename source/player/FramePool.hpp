@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+#include <functional>
+
+namespace bplayer
+{
+
+// Fixed set of refcounted frames recycled between pipeline stages
+// A frame is free again once every consumer has dropped its shared_ptr,
+// so the steady state runs without any allocation.
+class FramePool {
+public:
+    // Attaches the image buffer to a frame, defaults to av_frame_get_buffer
+    using Allocator = std::function<bool(AVFrame*)>;
+
+    FramePool();
+    ~FramePool();
+
+    bool init(size_t count, int width, int height, AVPixelFormat pixFmt, 
+        Allocator allocator = nullptr);
+    void reset();
+    // Waits while every frame is still in flight, nullptr once stopped;
+    // safe to call from several threads
+    std::shared_ptr<AVFrame> acquire(const std::atomic<bool>& running);
+
+    size_t size() const;
+
+private:
+    static constexpr int ALIGN_BUFFER = 32;
+    static constexpr int64_t INTERVAL_RETRY_US = 1000;
+
+    std::vector<std::shared_ptr<AVFrame>> frames_;
+    size_t indexNext_ = 0;
+    // Two callers must not both see a frame as free
+    std::mutex mutex_;
+};
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "BlockingQueue.hpp"
+#include "SpscQueue.hpp"
+
+namespace bplayer{
+
+// Queue linking two pipeline stages: exactly one producer, one consumer
+// Build with BPLAYER_LOCKED_QUEUE to fall back to the mutex/condvar queue.
+// Always give a capacity: SpscQueue has no unbounded mode and throws on 0,
+// which BlockingQueue would take as "no limit".
+#ifdef BPLAYER_LOCKED_QUEUE
+template<typename T>
+using PipeQueue = BlockingQueue<T>;
+#else
+template<typename T>
+using PipeQueue = SpscQueue<T>;
+#endif
+
+}
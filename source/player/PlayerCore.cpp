@@ -4,11 +4,11 @@ namespace bplayer
 {
 
 PlayerCore::PlayerCore()
-    : loader_(ctxFormat_),
-        demuxer_(queuePacketVideo_, queuePacketAudio_, ctxFormat_, streamVideo_, streamAudio_, state_, config_), 
-        decoderVideo_(queuePacketVideo_, queueFrameRaw_, streamVideo_, state_, config_, frameParSrc_), 
-        rendererVideo_(queueFrameRaw_, queueFrameDst_, state_, config_, frameParSrc_, frameParDst_), 
-        displayerVideo_(queueFrameDst_, state_, config_, frameParSrc_, frameParDst_)
+    : loader_(ctxFormat_, config_, telemetry_, probeCache_),
+        demuxer_(queuePacketVideo_, queuePacketAudio_, ctxFormat_, streamVideo_, streamAudio_, state_, config_, telemetry_, probeCache_), 
+        decoderVideo_(queuePacketVideo_, queueFrameRaw_, timer_, streamVideo_, state_, config_, telemetry_, frameParSrc_, frameParDst_), 
+        rendererVideo_(queueFrameRaw_, queueFrameDst_, state_, config_, telemetry_, frameParSrc_, frameParDst_), 
+        displayerVideo_(queueFrameDst_, timer_, state_, config_, telemetry_, frameParSrc_, frameParDst_)
 {
 	
 }
@@ -17,6 +17,11 @@ PlayerCore::PlayerCore()
 PlayerCore::~PlayerCore()
 {
     state_.running = false;
+    // Wakes every stage blocked on a queue, whatever its state
+    queuePacketVideo_.shutdown();
+    queuePacketAudio_.shutdown();
+    queueFrameRaw_.shutdown();
+    queueFrameDst_.shutdown();
 
     if (threadDemuxer_.joinable()) {
         threadDemuxer_.join();
@@ -30,16 +35,16 @@ PlayerCore::~PlayerCore()
     if (threadDisplayerVideo_.joinable()) {
         threadDisplayerVideo_.join();
     }
+    if (threadTelemetry_.joinable()) {
+        threadTelemetry_.join();
+    }
 
     queuePacketVideo_.flush();
     queuePacketAudio_.flush();
     queueFrameRaw_.flush();
     queueFrameDst_.flush();
-
-    queuePacketVideo_.shutdown();
-    queuePacketAudio_.shutdown();
-    queueFrameRaw_.shutdown();
-    queueFrameDst_.shutdown();
+    // Whatever playback did not get to write, e.g. opened but never played
+    probeCache_.save();
 
     if (ctxFormat_) {
         avformat_close_input(&ctxFormat_);
@@ -54,7 +59,15 @@ bool PlayerCore::init(const std::string& path, Orientation orientation,
         std::cerr << "[PlayerCore] Failed when loading" << std::endl;
         return false;
     }
-    if (!demuxer_.init()) {
+    // The panel comes first, stream selection needs its size
+    if (!displayerVideo_.open(orientation)) {
+        std::cerr << "[PlayerCore] Failed to initialize video displayer" << std::endl;
+        return false;
+    }
+    int widthTarget = 0;
+    int heightTarget = 0;
+    displayerVideo_.getSizeTarget(width, height, widthTarget, heightTarget);
+    if (!demuxer_.init(widthTarget, heightTarget)) {
         std::cerr << "[PlayerCore] Failed to initialize demuxer" << std::endl;
         return false;
     }
@@ -62,11 +75,15 @@ bool PlayerCore::init(const std::string& path, Orientation orientation,
         std::cerr << "[PlayerCore] Failed to initialize video decoder" << std::endl;
         return false;
     }
-    if (!displayerVideo_.init(orientation, width, height, offsetX, offsetY)) {
-        std::cerr << "[PlayerCore] Failed to initialize video displayer" << std::endl;
+    if (!displayerVideo_.setArea(width, height, offsetX, offsetY)) {
+        std::cerr << "[PlayerCore] Failed to set the display area" << std::endl;
+        return false;
+    }
+    if (!decoderVideo_.open()) {
+        std::cerr << "[PlayerCore] Failed to open video decoder" << std::endl;
         return false;
     }
-    if (!rendererVideo_.init()) {
+    if (!rendererVideo_.init(displayerVideo_.getScreen())) {
         std::cerr << "[PlayerCore] Failed to initialize video renderer" << std::endl;
         return false;
     }
@@ -86,11 +103,18 @@ void PlayerCore::play()
     
     state_.running = true;
     state_.paused = false;
+    state_.seeking = false;
+    // Seeking reopens, the stages keep their serials
+    state_.serialSeek = state_.serialSeek & ~PlayerState::SERIAL_SEEK_CLOSED;
 
+    telemetry_.reset();
     threadDemuxer_ = std::thread(&Demuxer::run, &demuxer_);
     threadDecoderVideo_ = std::thread(&DecoderVideo::run, &decoderVideo_);
     threadRendererVideo_ = std::thread(&RendererVideo::run, &rendererVideo_);
     threadDisplayerVideo_ = std::thread(&DisplayerVideo::run, &displayerVideo_);
+    if (config_.intervalTelemetryMs > 0) {
+        threadTelemetry_ = std::thread(&PlayerCore::dumpTelemetry, this);
+    }
 
     if (threadDemuxer_.joinable()) {
         threadDemuxer_.join();
@@ -104,6 +128,9 @@ void PlayerCore::play()
     if (threadDisplayerVideo_.joinable()) {
         threadDisplayerVideo_.join();
     }
+    if (threadTelemetry_.joinable()) {
+        threadTelemetry_.join();
+    }
 }
 
 void PlayerCore::stop()
@@ -114,7 +141,12 @@ void PlayerCore::stop()
 
     state_.running = false;
     state_.paused = false;
-    
+    // A stage blocked in push() or pop() would never see "running" again
+    queuePacketVideo_.shutdown();
+    queuePacketAudio_.shutdown();
+    queueFrameRaw_.shutdown();
+    queueFrameDst_.shutdown();
+
     if (threadDemuxer_.joinable()) {
         threadDemuxer_.join();
     }
@@ -127,16 +159,58 @@ void PlayerCore::stop()
     if (threadDisplayerVideo_.joinable()) {
         threadDisplayerVideo_.join();
     }
+    if (threadTelemetry_.joinable()) {
+        threadTelemetry_.join();
+    }
 
     queuePacketVideo_.flush();
     queuePacketAudio_.flush();
     queueFrameRaw_.flush();
     queueFrameDst_.flush();
+}
 
-    queuePacketVideo_.shutdown();
-    queuePacketAudio_.shutdown();
-    queueFrameRaw_.shutdown();
-    queueFrameDst_.shutdown();
+bool PlayerCore::seek(int64_t targetUs, SeekMode mode)
+{
+    if (!state_.running) {
+        return false;
+    }
+    state_.seekTargetUs = targetUs;
+    state_.seekMode = mode;
+    state_.seekRequestUs = Timer::nowUs();
+    state_.seeking = true;
+    // Last: a stage seeing the new serial finds the request complete
+    uint64_t serial = state_.serialSeek.load();
+    while (!(serial & PlayerState::SERIAL_SEEK_CLOSED)) {
+        if (state_.serialSeek.compare_exchange_weak(serial, serial + 1)) {
+            return true;
+        }
+    }
+    // The displayer took the end of stream first
+    state_.seeking = false;
+    return false;
 }
 
-}
\ No newline at end of file
+PlayerConfig& PlayerCore::getConfig()
+{
+    return config_;
+}
+
+TelemetrySnapshot PlayerCore::getTelemetry() const
+{
+    return telemetry_.snapshot();
+}
+
+// Periodic dump, sleeps in short slices so stop() is not held up
+void PlayerCore::dumpTelemetry()
+{
+    auto next = std::chrono::steady_clock::now();
+    while (state_.running.load()) {
+        next += std::chrono::milliseconds(config_.intervalTelemetryMs.load());
+        while (state_.running.load() && std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        telemetry_.snapshot().print(std::cout);
+    }
+}
+
+}
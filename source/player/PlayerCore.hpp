@@ -3,8 +3,9 @@
 #include "common.hpp"
 #include "ffmpeg.hpp"
 
-#include "BlockingQueue.hpp"
+#include "PipeQueue.hpp"
 #include "Timer.hpp"
+#include "Telemetry.hpp"
 #include "Loader.hpp"
 #include "Demuxer.hpp"
 #include "DecoderVideo.hpp"
@@ -29,19 +30,25 @@ private:
     
     PlayerState state_;
 
+    Timer timer_;
+
     PlayerConfig config_;
 
+    Telemetry telemetry_;
+
     FrameParameter frameParSrc_;
     FrameParameter frameParDst_;
 
-    BlockingQueue<std::shared_ptr<AVPacket>> queuePacketVideo_ = 
-        BlockingQueue<std::shared_ptr<AVPacket>>(MAX_QUEUE_SIZE_PACKET);
-    BlockingQueue<std::shared_ptr<AVPacket>> queuePacketAudio_ = 
-        BlockingQueue<std::shared_ptr<AVPacket>>(MAX_QUEUE_SIZE_PACKET);
-    BlockingQueue<std::shared_ptr<AVFrame>> queueFrameRaw_ =
-        BlockingQueue<std::shared_ptr<AVFrame>>(MAX_QUEUE_SIZE_FRAME);
-    BlockingQueue<std::shared_ptr<AVFrame>> queueFrameDst_ =
-        BlockingQueue<std::shared_ptr<AVFrame>>(MAX_QUEUE_SIZE_FRAME);
+    PipeQueue<std::shared_ptr<AVPacket>> queuePacketVideo_ = 
+        PipeQueue<std::shared_ptr<AVPacket>>(MAX_QUEUE_SIZE_PACKET);
+    PipeQueue<std::shared_ptr<AVPacket>> queuePacketAudio_ = 
+        PipeQueue<std::shared_ptr<AVPacket>>(MAX_QUEUE_SIZE_PACKET);
+    PipeQueue<std::shared_ptr<AVFrame>> queueFrameRaw_ =
+        PipeQueue<std::shared_ptr<AVFrame>>(MAX_QUEUE_SIZE_FRAME);
+    PipeQueue<std::shared_ptr<AVFrame>> queueFrameDst_ =
+        PipeQueue<std::shared_ptr<AVFrame>>(MAX_QUEUE_SIZE_FRAME);
+
+    ProbeCache probeCache_;
 
     Loader loader_;
     Demuxer demuxer_;
@@ -53,12 +60,24 @@ private:
     std::thread threadDecoderVideo_;
     std::thread threadRendererVideo_;
     std::thread threadDisplayerVideo_;
+    std::thread threadTelemetry_;
+
+    void dumpTelemetry();
 
 public:
     bool init(const std::string& path, Orientation orientation, 
         int width, int height, int offsetX, int offsetY);
     void play();
     void stop();
+    // Jump to a media time (us, the time base of the frame pts) while
+    // playing, from any thread; a request not carried out yet is replaced
+    // False once the playback has ended or is not running
+    bool seek(int64_t targetUs, SeekMode mode = SeekMode::Accurate);
+
+    // Consistent-enough view of the pipeline metrics, callable any time
+    TelemetrySnapshot getTelemetry() const;
+    // Tunables, set before init() unless documented otherwise
+    PlayerConfig& getConfig();
 };
 
 
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <climits>
+#include <ctime>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+namespace bplayer{
+
+// Bounded single-producer/single-consumer ring with BlockingQueue semantics
+// push/try_push must only be called by the producer thread, pop/popFor/
+// front/flush by the consumer thread (or while the consumer is idle).
+// The fast path is lock-free; a thread only sleeps (futex) when the ring is
+// empty or full, and the other side only issues a wake syscall when
+// somebody is actually sleeping.
+template<typename T>
+class SpscQueue {
+public:
+    // The ring is always bounded: unlike BlockingQueue, 0 does not mean "no
+    // limit", it throws std::invalid_argument
+    explicit SpscQueue(size_t maxSize)
+        : maxSize_(checkCapacity(maxSize)),
+            mask_(roundUpPow2(maxSize_) - 1),
+            slots_(mask_ + 1)
+    {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    template<typename U>
+    bool push(U&& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (!hasSpace(tail)) {
+            waitUntil(notFull_, [&]() {
+                return isShutdown_.load(std::memory_order_acquire) || hasSpace(tail);
+            }, nullptr);
+        }
+        if (isShutdown_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        slots_[tail & mask_] = std::forward<U>(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake(notEmpty_);
+        return true;
+    }
+
+    template<typename U>
+    bool try_push(U&& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (!hasSpace(tail)) {
+            return false;
+        }
+        slots_[tail & mask_] = std::forward<U>(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake(notEmpty_);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (!hasItem(head)) {
+            waitUntil(notEmpty_, [&]() {
+                return isShutdown_.load(std::memory_order_acquire) || hasItem(head);
+            }, nullptr);
+            if (!hasItem(head)) return false;
+        }
+        take(head, item);
+        return true;
+    }
+
+    bool popFor(T& item, std::chrono::milliseconds timeout) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (!hasItem(head)) {
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            waitUntil(notEmpty_, [&]() {
+                return isShutdown_.load(std::memory_order_acquire) || hasItem(head);
+            }, &deadline);
+            if (!hasItem(head)) return false;
+        }
+        take(head, item);
+        return true;
+    }
+
+    bool front(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (!hasItem(head)) {
+            return false;
+        }
+        item = slots_[head & mask_];
+        return true;
+    }
+
+    void flush() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        while (head != tail) {
+            slots_[head & mask_] = T();
+            head++;
+        }
+        head_.store(head, std::memory_order_release);
+        wake(notFull_);
+    }
+
+    void shutdown() {
+        isShutdown_.store(true, std::memory_order_release);
+        wake(notEmpty_, true);
+        wake(notFull_, true);
+    }
+
+    size_t size() {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    size_t capacity() {
+        return maxSize_;
+    }
+
+    bool empty() {
+        return size() == 0;
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    // Futex word bumped on every wake-up, plus the number of sleepers
+    struct Event {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint32_t> waiters{0};
+    };
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+        "futex word must be a plain 32-bit integer");
+
+    const size_t maxSize_;
+    const size_t mask_;
+    std::vector<T> slots_;
+
+    // Consumer side
+    alignas(CACHE_LINE) std::atomic<size_t> head_{0};
+    size_t tailCache_ = 0;
+    // Producer side
+    alignas(CACHE_LINE) std::atomic<size_t> tail_{0};
+    size_t headCache_ = 0;
+
+    alignas(CACHE_LINE) Event notEmpty_;
+    alignas(CACHE_LINE) Event notFull_;
+    alignas(CACHE_LINE) std::atomic<bool> isShutdown_{false};
+
+    static size_t checkCapacity(size_t maxSize) {
+        if (maxSize == 0) {
+            throw std::invalid_argument("SpscQueue needs a capacity above 0");
+        }
+        return maxSize;
+    }
+
+    static size_t roundUpPow2(size_t n) {
+        size_t size = 1;
+        while (size < n) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    // Producer only
+    bool hasSpace(size_t tail) {
+        if (tail - headCache_ < maxSize_) {
+            return true;
+        }
+        headCache_ = head_.load(std::memory_order_acquire);
+        return tail - headCache_ < maxSize_;
+    }
+
+    // Consumer only
+    bool hasItem(size_t head) {
+        if (head != tailCache_) {
+            return true;
+        }
+        tailCache_ = tail_.load(std::memory_order_acquire);
+        return head != tailCache_;
+    }
+
+    void take(size_t head, T& item) {
+        item = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        wake(notFull_);
+    }
+
+    template<typename Pred>
+    void waitUntil(Event& event, Pred ready,
+        const std::chrono::steady_clock::time_point* deadline) {
+        while (true) {
+            uint32_t seq = event.seq.load(std::memory_order_acquire);
+            event.waiters.fetch_add(1, std::memory_order_relaxed);
+            // Pairs with the fence in wake(): either we see the new state
+            // or the other side sees us sleeping and bumps "seq"
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                event.waiters.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+            timespec ts{};
+            timespec* pts = nullptr;
+            if (deadline) {
+                auto remaining = *deadline - std::chrono::steady_clock::now();
+                if (remaining <= std::chrono::steady_clock::duration::zero()) {
+                    event.waiters.fetch_sub(1, std::memory_order_relaxed);
+                    return;
+                }
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    remaining).count();
+                ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+                ts.tv_nsec = static_cast<long>(ns % 1000000000);
+                pts = &ts;
+            }
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&event.seq),
+                FUTEX_WAIT_PRIVATE, seq, pts, nullptr, 0);
+            event.waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    void wake(Event& event, bool force = false) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!force && event.waiters.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+        event.seq.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&event.seq),
+            FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+};
+
+}
@@ -0,0 +1,299 @@
+#include "Telemetry.hpp"
+
+#include "Timer.hpp"
+
+#include <iomanip>
+#include <ctime>
+
+namespace bplayer
+{
+
+double Histogram::Snapshot::mean() const
+{
+    return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+}
+
+int64_t Histogram::Snapshot::percentile(double quantile) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(quantile * count);
+    uint64_t seen = 0;
+    for (int i = 0; i < COUNT_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            // Never report more than was actually observed
+            return std::min(i == 0 ? int64_t(1) : (int64_t(1) << i), max);
+        }
+    }
+    return max;
+}
+
+void Histogram::record(int64_t value)
+{
+    if (value < 0) {
+        value = 0;
+    }
+    int index = 0;
+    if (value > 0) {
+        // Bit length of the value, i.e. floor(log2(value)) + 1
+        index = 64 - __builtin_clzll(static_cast<uint64_t>(value));
+        index = std::min(index, COUNT_BUCKETS - 1);
+    }
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    int64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max
+        && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+    Snapshot snap;
+    for (int i = 0; i < COUNT_BUCKETS; i++) {
+        snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    }
+    snap.count = count_.load(std::memory_order_relaxed);
+    snap.sum = sum_.load(std::memory_order_relaxed);
+    snap.max = max_.load(std::memory_order_relaxed);
+    return snap;
+}
+
+void Histogram::reset()
+{
+    for (auto& bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+void GaugeQueue::sample(size_t size, size_t capacity)
+{
+    samples_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(size, std::memory_order_relaxed);
+    last_.store(size, std::memory_order_relaxed);
+    capacity_.store(capacity, std::memory_order_relaxed);
+    // Only the consumer samples, a plain max update is enough
+    if (size > max_.load(std::memory_order_relaxed)) {
+        max_.store(size, std::memory_order_relaxed);
+    }
+}
+
+GaugeQueue::Snapshot GaugeQueue::snapshot() const
+{
+    Snapshot snap;
+    snap.samples = samples_.load(std::memory_order_relaxed);
+    snap.last = last_.load(std::memory_order_relaxed);
+    snap.max = max_.load(std::memory_order_relaxed);
+    snap.capacity = capacity_.load(std::memory_order_relaxed);
+    if (snap.samples > 0) {
+        snap.mean = static_cast<double>(sum_.load(std::memory_order_relaxed))
+            / snap.samples;
+    }
+    return snap;
+}
+
+void GaugeQueue::reset()
+{
+    samples_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    last_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+const char* stageName(Stage stage)
+{
+    switch (stage) {
+    case Stage::Demuxer:
+        return "demuxer";
+    case Stage::DecoderVideo:
+        return "decoder";
+    case Stage::RendererVideo:
+        return "renderer";
+    case Stage::DisplayerVideo:
+        return "displayer";
+    default:
+        return "unknown";
+    }
+}
+
+const char* pipeName(Pipe pipe)
+{
+    switch (pipe) {
+    case Pipe::PacketVideo:
+        return "packet";
+    case Pipe::FrameRaw:
+        return "frameRaw";
+    case Pipe::FrameDst:
+        return "frameDst";
+    default:
+        return "unknown";
+    }
+}
+
+void StageMetrics::reset()
+{
+    process.reset();
+    waitInput.reset();
+    waitOutput.reset();
+    items.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    cpuUs.store(0, std::memory_order_relaxed);
+}
+
+void StageMetrics::sampleCpu()
+{
+    timespec ts{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        cpuUs.store(static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000,
+            std::memory_order_relaxed);
+    }
+}
+
+void StageMetrics::accumulateCpu(int64_t& last)
+{
+    timespec ts{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        int64_t now = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        cpuUs.fetch_add(now - last, std::memory_order_relaxed);
+        last = now;
+    }
+}
+
+double TelemetrySnapshot::fps() const
+{
+    if (elapsedUs <= 0) {
+        return 0.0;
+    }
+    return framesDisplayed * 1e6 / elapsedUs;
+}
+
+double TelemetrySnapshot::fpsBusLimit() const
+{
+    if (busTimeNs <= 0) {
+        return 0.0;
+    }
+    return framesDisplayed * 1e9 / busTimeNs;
+}
+
+void TelemetrySnapshot::print(std::ostream& os) const
+{
+    auto printHistogram = [&os](const char* name, const Histogram::Snapshot& h) {
+        os << " " << name << " avg/p50/p99/max "
+            << static_cast<int64_t>(h.mean()) << "/" << h.percentile(0.5) << "/"
+            << h.percentile(0.99) << "/" << h.max << "us";
+    };
+
+    os << std::fixed << std::setprecision(1);
+    os << "[Telemetry] elapsed " << elapsedUs / 1000 << "ms, displayed "
+        << framesDisplayed << " (" << fps() << " fps), bus "
+        << bytesBus << " bytes";
+    if (busTimeNs > 0) {
+        os << " in " << busTimeNs / 1000000 << "ms (bus limit "
+            << fpsBusLimit() << " fps)";
+    }
+    os << std::endl;
+    for (size_t i = 0; i < stages.size(); i++) {
+        const StageSnapshot& s = stages[i];
+        os << "[Telemetry] " << stageName(static_cast<Stage>(i))
+            << ": items " << s.items << ", dropped " << s.dropped
+            << ", cpu " << s.cpuUs / 1000 << "ms, threads " << s.threads;
+        if (!s.mode.empty()) {
+            os << " (" << s.mode << ")";
+        }
+        printHistogram("process", s.process);
+        printHistogram("in", s.waitInput);
+        printHistogram("out", s.waitOutput);
+        os << std::endl;
+    }
+    for (size_t i = 0; i < pipes.size(); i++) {
+        const GaugeQueue::Snapshot& p = pipes[i];
+        os << "[Telemetry] queue " << pipeName(static_cast<Pipe>(i))
+            << ": last " << p.last << ", mean " << p.mean << ", max "
+            << p.max << "/" << p.capacity << std::endl;
+    }
+    os << "[Telemetry]";
+    printHistogram("pts-to-glass", latencyGlass);
+    if (latencySeek.count > 0) {
+        os << ", " << latencySeek.count << " seeks";
+        printHistogram("seek-to-glass", latencySeek);
+    }
+    os << std::endl;
+    os << std::defaultfloat;
+}
+
+Telemetry::Telemetry()
+{
+    reset();
+}
+
+Telemetry::~Telemetry()
+{
+
+}
+
+void Telemetry::reset()
+{
+    for (auto& stage : stages_) {
+        stage.reset();
+    }
+    for (auto& pipe : pipes_) {
+        pipe.reset();
+    }
+    framesDisplayed_.store(0, std::memory_order_relaxed);
+    bytesBus_.store(0, std::memory_order_relaxed);
+    busTimeNs_.store(0, std::memory_order_relaxed);
+    latencyGlass_.reset();
+    latencySeek_.reset();
+    startUs_.store(Timer::nowUs(), std::memory_order_relaxed);
+}
+
+void Telemetry::addFrameDisplayed(uint64_t bytesBus, int64_t busTimeNs, 
+    int64_t latencyGlassUs)
+{
+    framesDisplayed_.fetch_add(1, std::memory_order_relaxed);
+    bytesBus_.fetch_add(bytesBus, std::memory_order_relaxed);
+    busTimeNs_.fetch_add(busTimeNs, std::memory_order_relaxed);
+    if (latencyGlassUs != AV_NOPTS_VALUE) {
+        latencyGlass_.record(latencyGlassUs);
+    }
+}
+
+void Telemetry::addSeek(int64_t latencyUs)
+{
+    latencySeek_.record(latencyUs);
+}
+
+TelemetrySnapshot Telemetry::snapshot() const
+{
+    TelemetrySnapshot snap;
+    snap.elapsedUs = Timer::nowUs() - startUs_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < stages_.size(); i++) {
+        const StageMetrics& stage = stages_[i];
+        TelemetrySnapshot::StageSnapshot& s = snap.stages[i];
+        s.process = stage.process.snapshot();
+        s.waitInput = stage.waitInput.snapshot();
+        s.waitOutput = stage.waitOutput.snapshot();
+        s.items = stage.items.load(std::memory_order_relaxed);
+        s.dropped = stage.dropped.load(std::memory_order_relaxed);
+        s.cpuUs = stage.cpuUs.load(std::memory_order_relaxed);
+        s.threads = stage.threads.load(std::memory_order_relaxed);
+        s.mode = stage.mode.load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < pipes_.size(); i++) {
+        snap.pipes[i] = pipes_[i].snapshot();
+    }
+    snap.framesDisplayed = framesDisplayed_.load(std::memory_order_relaxed);
+    snap.bytesBus = bytesBus_.load(std::memory_order_relaxed);
+    snap.busTimeNs = busTimeNs_.load(std::memory_order_relaxed);
+    snap.latencyGlass = latencyGlass_.snapshot();
+    snap.latencySeek = latencySeek_.snapshot();
+    return snap;
+}
+
+}
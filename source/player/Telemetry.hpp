@@ -0,0 +1,185 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <array>
+#include <ostream>
+
+namespace bplayer
+{
+
+// Latency histogram with fixed power-of-two buckets
+// Bucket 0 holds values below 1 us, bucket i holds [2^(i-1), 2^i) us,
+// the last bucket everything above. record() is a handful of relaxed
+// atomic adds, so it can sit on every hot path.
+class Histogram {
+public:
+    static constexpr int COUNT_BUCKETS = 28;
+
+    struct Snapshot {
+        uint64_t count = 0;
+        int64_t sum = 0;
+        int64_t max = 0;
+        std::array<uint64_t, COUNT_BUCKETS> buckets{};
+
+        double mean() const;
+        // Upper bound of the bucket holding the given quantile (0..1)
+        int64_t percentile(double quantile) const;
+    };
+
+    void record(int64_t value);
+    Snapshot snapshot() const;
+    void reset();
+
+private:
+    std::array<std::atomic<uint64_t>, COUNT_BUCKETS> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<int64_t> sum_{0};
+    std::atomic<int64_t> max_{0};
+};
+
+// Occupancy of a pipe queue, sampled by its consumer
+class GaugeQueue {
+public:
+    struct Snapshot {
+        uint64_t samples = 0;
+        size_t last = 0;
+        size_t max = 0;
+        size_t capacity = 0;
+        double mean = 0.0;
+    };
+
+    void sample(size_t size, size_t capacity);
+    Snapshot snapshot() const;
+    void reset();
+
+private:
+    std::atomic<uint64_t> samples_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<size_t> last_{0};
+    std::atomic<size_t> max_{0};
+    std::atomic<size_t> capacity_{0};
+};
+
+enum class Stage {
+    Demuxer = 0,
+    DecoderVideo,
+    RendererVideo,
+    DisplayerVideo,
+    Count
+};
+
+const char* stageName(Stage stage);
+
+// Everything one pipeline thread reports
+struct StageMetrics {
+    // Time spent working on one item
+    Histogram process;
+    // Time blocked waiting for input; the demuxer's input is the storage,
+    // its share of each packet read when a custom reader is in use
+    Histogram waitInput;
+    // Time blocked handing the result downstream
+    Histogram waitOutput;
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> dropped{0};
+    // CPU time of the stage thread
+    std::atomic<int64_t> cpuUs{0};
+    // Threads working for the stage and how they share it, set when the
+    // stage is configured and kept by reset()
+    std::atomic<int> threads{1};
+    std::atomic<const char*> mode{""};
+    // Running total of the time spent inside storage reads, added by the
+    // Loader's reader and diffed by the demuxer around each packet; never
+    // reset, only the differences count
+    std::atomic<int64_t> stallIoUs{0};
+
+    void reset();
+    // Call from the stage thread
+    void sampleCpu();
+    // Stages running several threads: each adds the CPU time it used
+    // since its own "last" sample
+    void accumulateCpu(int64_t& last);
+};
+
+enum class Pipe {
+    PacketVideo = 0,
+    FrameRaw,
+    FrameDst,
+    Count
+};
+
+const char* pipeName(Pipe pipe);
+
+struct TelemetrySnapshot {
+    struct StageSnapshot {
+        Histogram::Snapshot process;
+        Histogram::Snapshot waitInput;
+        Histogram::Snapshot waitOutput;
+        uint64_t items = 0;
+        uint64_t dropped = 0;
+        int64_t cpuUs = 0;
+        int threads = 1;
+        std::string mode;
+    };
+
+    int64_t elapsedUs = 0;
+    std::array<StageSnapshot, static_cast<size_t>(Stage::Count)> stages;
+    std::array<GaugeQueue::Snapshot, static_cast<size_t>(Pipe::Count)> pipes;
+    uint64_t framesDisplayed = 0;
+    uint64_t bytesBus = 0;
+    // Modelled wire time (virtual panels only, 0 on real hardware)
+    int64_t busTimeNs = 0;
+    // Wall time between the moment a pts was due and the end of its transfer
+    Histogram::Snapshot latencyGlass;
+    // From a seek request to the end of the transfer of its first frame
+    Histogram::Snapshot latencySeek;
+
+    const StageSnapshot& stage(Stage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+    const GaugeQueue::Snapshot& pipe(Pipe pipe) const {
+        return pipes[static_cast<size_t>(pipe)];
+    }
+    double fps() const;
+    // Frame rate the bus alone would allow, 0 when the wire time is unknown
+    double fpsBusLimit() const;
+
+    void print(std::ostream& os) const;
+};
+
+// Lock-free metrics shared by all pipeline stages
+// Each stage only writes its own StageMetrics; snapshot() may run on any
+// thread and sees a slightly torn but monotonic picture.
+class Telemetry {
+public:
+    Telemetry();
+    ~Telemetry();
+
+    // Clears everything and restarts the elapsed time
+    void reset();
+
+    StageMetrics& stage(Stage stage) {
+        return stages_[static_cast<size_t>(stage)];
+    }
+    GaugeQueue& pipe(Pipe pipe) {
+        return pipes_[static_cast<size_t>(pipe)];
+    }
+
+    void addFrameDisplayed(uint64_t bytesBus, int64_t busTimeNs, 
+        int64_t latencyGlassUs);
+    void addSeek(int64_t latencyUs);
+
+    TelemetrySnapshot snapshot() const;
+
+private:
+    std::array<StageMetrics, static_cast<size_t>(Stage::Count)> stages_;
+    std::array<GaugeQueue, static_cast<size_t>(Pipe::Count)> pipes_;
+    std::atomic<uint64_t> framesDisplayed_{0};
+    std::atomic<uint64_t> bytesBus_{0};
+    std::atomic<int64_t> busTimeNs_{0};
+    Histogram latencyGlass_;
+    Histogram latencySeek_;
+    std::atomic<int64_t> startUs_{0};
+};
+
+}
@@ -0,0 +1,128 @@
+#include "Timer.hpp"
+
+namespace bplayer
+{
+
+Timer::Timer()
+{
+
+}
+
+Timer::~Timer()
+{
+
+}
+
+void Timer::start(int64_t mediaUs)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    started_ = true;
+    anchorMediaUs_ = mediaUs;
+    anchorWall_ = Clock::now();
+}
+
+void Timer::reset()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    started_ = false;
+    paused_ = false;
+    anchorMediaUs_ = 0;
+}
+
+void Timer::pause()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (paused_) {
+        return;
+    }
+    reanchorLocked();
+    paused_ = true;
+}
+
+void Timer::resume()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!paused_) {
+        return;
+    }
+    anchorWall_ = Clock::now();
+    paused_ = false;
+}
+
+void Timer::setSpeed(double speed)
+{
+    if (speed <= 0.0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (speed == speed_) {
+        return;
+    }
+    reanchorLocked();
+    speed_ = speed;
+}
+
+bool Timer::isStarted() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return started_;
+}
+
+bool Timer::isPaused() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return paused_;
+}
+
+double Timer::getSpeed() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return speed_;
+}
+
+int64_t Timer::getTimeUs() const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    return getTimeUsLocked(Clock::now());
+}
+
+Timer::Clock::time_point Timer::getDeadline(int64_t mediaUs) const
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!started_ || paused_) {
+        // Nothing is due while the clock stands still
+        return Clock::time_point::max();
+    }
+    auto wallUs = static_cast<int64_t>((mediaUs - anchorMediaUs_) / speed_);
+    return anchorWall_ + std::chrono::microseconds(wallUs);
+}
+
+int64_t Timer::nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+int64_t Timer::getTimeUsLocked(Clock::time_point now) const
+{
+    if (!started_) {
+        return AV_NOPTS_VALUE;
+    }
+    if (paused_) {
+        return anchorMediaUs_;
+    }
+    auto elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - anchorWall_).count();
+    return anchorMediaUs_ + static_cast<int64_t>(elapsedUs * speed_);
+}
+
+void Timer::reanchorLocked()
+{
+    auto now = Clock::now();
+    if (started_ && !paused_) {
+        anchorMediaUs_ = getTimeUsLocked(now);
+    }
+    anchorWall_ = now;
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+namespace bplayer
+{
+
+// Master presentation clock
+// Maps media time (us) onto the monotonic wall clock. The mapping is
+// re-anchored on every pause/resume/speed change, so deadlines handed out
+// stay absolute and never drift.
+class Timer {
+public:
+    using Clock = std::chrono::steady_clock;
+    // Lag beyond which the clock is re-anchored instead of dropping frames
+    static constexpr int64_t THRESHOLD_RESYNC_US = 500000;
+
+    Timer();
+    ~Timer();
+
+    // Anchor media time "mediaUs" to the current wall clock
+    void start(int64_t mediaUs);
+    void reset();
+    void pause();
+    void resume();
+    void setSpeed(double speed);
+
+    bool isStarted() const;
+    bool isPaused() const;
+    double getSpeed() const;
+
+    // Current media time in us
+    int64_t getTimeUs() const;
+    // Wall clock moment at which media time reaches "mediaUs"
+    Clock::time_point getDeadline(int64_t mediaUs) const;
+
+    static int64_t nowUs();
+
+private:
+    mutable std::mutex mutex_;
+    bool started_ = false;
+    bool paused_ = false;
+    double speed_ = 1.0;
+    // Media time at the moment "anchorWall_"
+    int64_t anchorMediaUs_ = 0;
+    Clock::time_point anchorWall_;
+
+    int64_t getTimeUsLocked(Clock::time_point now) const;
+    void reanchorLocked();
+};
+
+}
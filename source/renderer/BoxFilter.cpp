@@ -0,0 +1,131 @@
+#include "BoxFilter.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace bplayer
+{
+
+BoxFilter::BoxFilter()
+{
+
+}
+
+BoxFilter::~BoxFilter()
+{
+
+}
+
+const char* BoxFilter::getKernelName()
+{
+#if defined(__SSE2__)
+    return "sse2";
+#elif defined(__ARM_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+bool BoxFilter::init(int widthSrc, int heightSrc, int widthDst, int heightDst,
+    int slots)
+{
+    if (widthSrc <= 0 || heightSrc <= 0 || widthDst <= 0 || heightDst <= 0) {
+        return false;
+    }
+    widthSrc_ = widthSrc;
+    spansX_ = makeSpans(widthSrc, widthDst);
+    spansY_ = makeSpans(heightSrc, heightDst);
+    int rowsMin = MAX_ROWS_SPAN;
+    int rowsMax = 0;
+    for (const Span& span : spansY_) {
+        rowsMin = std::min(rowsMin, span.count);
+        rowsMax = std::max(rowsMax, span.count);
+    }
+    if (rowsMax > MAX_ROWS_SPAN || rowsMax - rowsMin > 1) {
+        return false;
+    }
+    rowsMin_ = rowsMin;
+    for (int k = 0; k < 2; k++) {
+        mul_[k].resize(widthDst);
+        for (int x = 0; x < widthDst; x++) {
+            uint64_t n = static_cast<uint64_t>(rowsMin + k) * spansX_[x].count;
+            mul_[k][x] = static_cast<uint32_t>(((1ull << SHIFT_AVERAGE) + n / 2) / n);
+        }
+    }
+    strideAcc_ = (static_cast<size_t>(widthSrc) + 15) & ~static_cast<size_t>(15);
+    acc_.assign(strideAcc_ * std::max(slots, 1), 0);
+    return true;
+}
+
+// Column blocks are summed over all rows in registers before one store,
+// every source byte is loaded exactly once
+const uint16_t* BoxFilter::accumulate(const uint8_t* plane, int stride, int y,
+    int slot)
+{
+    const Span& rows = spansY_[y];
+    const uint8_t* src = plane + static_cast<ptrdiff_t>(rows.start) * stride;
+    uint16_t* acc = acc_.data() + strideAcc_ * slot;
+    const int width = widthSrc_;
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+        __m128i lo = zero;
+        __m128i hi = zero;
+        const uint8_t* p = src + x;
+        for (int r = 0; r < rows.count; r++, p += stride) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + x), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + x + 8), hi);
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 16 <= width; x += 16) {
+        uint16x8_t lo = vdupq_n_u16(0);
+        uint16x8_t hi = vdupq_n_u16(0);
+        const uint8_t* p = src + x;
+        for (int r = 0; r < rows.count; r++, p += stride) {
+            uint8x16_t v = vld1q_u8(p);
+            lo = vaddw_u8(lo, vget_low_u8(v));
+            hi = vaddw_u8(hi, vget_high_u8(v));
+        }
+        vst1q_u16(acc + x, lo);
+        vst1q_u16(acc + x + 8, hi);
+    }
+#endif
+    for (; x < width; x++) {
+        uint16_t sum = 0;
+        const uint8_t* p = src + x;
+        for (int r = 0; r < rows.count; r++, p += stride) {
+            sum += *p;
+        }
+        acc[x] = sum;
+    }
+    return acc;
+}
+
+// Floor partition of the source; upscaling picks the nearest source pixel
+std::vector<BoxFilter::Span> BoxFilter::makeSpans(int sizeSrc, int sizeDst)
+{
+    std::vector<Span> spans(sizeDst);
+    for (int i = 0; i < sizeDst; i++) {
+        if (sizeSrc >= sizeDst) {
+            int start = static_cast<int>(static_cast<int64_t>(i) * sizeSrc / sizeDst);
+            int end = static_cast<int>(static_cast<int64_t>(i + 1) * sizeSrc / sizeDst);
+            spans[i] = {start, end - start};
+        } else {
+            int center = static_cast<int>((2 * static_cast<int64_t>(i) + 1) * sizeSrc
+                / (2 * sizeDst));
+            spans[i] = {center, 1};
+        }
+    }
+    return spans;
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace bplayer
+{
+
+// Box filter of one 8 bit plane onto a smaller size
+// Output row y averages a span of source rows and output pixel x a span
+// of source columns (floor partition of the source). accumulate() sums
+// the rows of a span into 16 bit column accumulators, with SSE2 / NEON
+// when compiled in; average() then reduces the columns of one pixel.
+// Upscaling degrades to nearest neighbour.
+class BoxFilter {
+public:
+    BoxFilter();
+    ~BoxFilter();
+
+    // Accumulation kernel compiled in: "sse2", "neon" or "scalar"
+    static const char* getKernelName();
+
+    // False when a span has more rows than the accumulators can hold;
+    // "slots" accumulator rows are kept, e.g. 2 for the U and V planes
+    bool init(int widthSrc, int heightSrc, int widthDst, int heightDst,
+        int slots = 1);
+
+    // Sum the source rows of output row "y" into accumulator "slot"
+    const uint16_t* accumulate(const uint8_t* plane, int stride, int y,
+        int slot = 0);
+
+    // Average of output pixel (x, y) from the accumulated row of "y"
+    int average(const uint16_t* acc, int y, int x) const {
+        const Span& cols = spansX_[x];
+        uint32_t sum = 0;
+        for (int i = 0; i < cols.count; i++) {
+            sum += acc[cols.start + i];
+        }
+        const uint32_t mul = mul_[spansY_[y].count - rowsMin_][x];
+        return static_cast<int>((sum * static_cast<uint64_t>(mul) 
+            + (1ull << (SHIFT_AVERAGE - 1))) >> SHIFT_AVERAGE);
+    }
+
+private:
+    // 16 bit accumulators: 257 rows of 255 still fit
+    static constexpr int MAX_ROWS_SPAN = 257;
+    // Fixed point of the averaging multipliers
+    static constexpr int SHIFT_AVERAGE = 24;
+
+    // Source columns or rows averaged into one output pixel
+    struct Span {
+        int start;
+        int count;
+    };
+
+    int widthSrc_ = 0;
+    std::vector<Span> spansX_;
+    std::vector<Span> spansY_;
+    // Floor partition: row spans have "rowsMin_" or "rowsMin_ + 1" rows,
+    // with one set of multipliers each
+    int rowsMin_ = 1;
+    std::vector<uint32_t> mul_[2];
+    std::vector<uint16_t> acc_;
+    size_t strideAcc_ = 0;
+
+    static std::vector<Span> makeSpans(int sizeSrc, int sizeDst);
+};
+
+}
@@ -1,20 +1,23 @@
 #include "RendererVideo.hpp"
 
 #include "SaveFrame.hpp"
+#include "Timer.hpp"
 
 namespace bplayer
 {
 
-RendererVideo::RendererVideo(BlockingQueue<std::shared_ptr<AVFrame>>& queueFrameRaw, 
-    BlockingQueue<std::shared_ptr<AVFrame>>& queueFrameDst, 
+RendererVideo::RendererVideo(PipeQueue<std::shared_ptr<AVFrame>>& queueFrameRaw, 
+    PipeQueue<std::shared_ptr<AVFrame>>& queueFrameDst, 
     PlayerState& state, 
     PlayerConfig& config, 
+    Telemetry& telemetry,
     FrameParameter& frameParSrc, 
     FrameParameter& frameParDst)
     : queueFrameRaw_(queueFrameRaw), 
         queueFrameDst_(queueFrameDst), 
         state_(state),
         config_(config),
+        telemetry_(telemetry),
         frameParSrc_(frameParSrc),
         frameParDst_(frameParDst)
 {
@@ -23,56 +26,217 @@ RendererVideo::RendererVideo(BlockingQueue<std::shared_ptr<AVFrame>>& queueFrame
 
 RendererVideo::~RendererVideo()
 {
-    sws_freeContext(ctxScaler_);
+
 }
 
-bool RendererVideo::init()
+bool RendererVideo::init(IDisplayer* screen)
 {
-    return setScalerVideo();
+    // The mono kernel needs the panel's page layout
+    screen_ = screen;
+    const size_t countWorkers = std::max(config_.countWorkersRenderer.load(), 1);
+    workers_.clear();
+    for (size_t i = 0; i < countWorkers; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->index = i;
+        worker->widthSrc = frameParSrc_.width;
+        worker->heightSrc = frameParSrc_.height;
+        worker->pixFmtSrc = frameParSrc_.pixFmt;
+        if (!setScalerVideo(*worker)) {
+            return false;
+        }
+        workers_.push_back(std::move(worker));
+    }
+    seqInput_ = 0;
+    seqOutput_ = 0;
+    reorder_.clear();
+    FramePool::Allocator allocator = nullptr;
+    if (screen_) {
+        // Render straight into the driver's transfer buffers
+        allocator = [this](AVFrame* frame) {
+            return screen_->allocFrame(frame);
+        };
+        if (screen_->getNativeLayout().pagePacked) {
+            // swscale can not produce page layout, scale first then pack;
+            // kept with the mono kernel for a source it can not take later
+            for (auto& worker : workers_) {
+                worker->frameScaled = make_avframe();
+                worker->frameScaled->width = frameParDst_.width;
+                worker->frameScaled->height = frameParDst_.height;
+                worker->frameScaled->format = frameParDst_.pixFmt;
+                int ret = av_frame_get_buffer(worker->frameScaled.get(), 32);
+                if (ret < 0) {
+                    std::cerr << "[Video Renderer] Failed to allocate image buffer: " 
+                        << ffmpegErrStr(ret) << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    // Every further worker holds one more frame while it waits for input
+    size_t countInFlight = FRAMES_IN_FLIGHT + (countWorkers - 1)
+        + std::max(config_.countBuffersTransmit.load(), 0);
+    if (!poolFrameDst_.init(queueFrameDst_.capacity() + countInFlight, 
+        frameParDst_.width, frameParDst_.height, frameParDst_.pixFmt, allocator)) {
+        std::cerr << "[Video Renderer] Failed to create frame pool" << std::endl;
+        return false;
+    }
+    telemetry_.stage(Stage::RendererVideo).threads = static_cast<int>(countWorkers);
+    if (countWorkers > 1) {
+        std::cout << "[Video Renderer] " << countWorkers << " render workers" 
+            << std::endl;
+    }
+    return true;
 }
 
+// Worker 0 runs on the calling thread, the others next to it
 void RendererVideo::run()
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers_.size(); i++) {
+        threads.emplace_back(&RendererVideo::runWorker, this, std::ref(*workers_[i]));
+    }
+    if (!workers_.empty()) {
+        runWorker(*workers_[0]);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void RendererVideo::runWorker(Worker& worker)
 {
     // int i = 1;
+    StageMetrics& metrics = telemetry_.stage(Stage::RendererVideo);
+    GaugeQueue& gauge = telemetry_.pipe(Pipe::FrameRaw);
+    int64_t cpuLast = 0;
+    // Input wait carried over popFor() timeouts
+    int64_t waitInput = 0;
     while (state_.running.load()) {
-        auto frameSrc = make_avframe();
-        auto frameDst = make_avframe();
-
-        frameDst->width = frameParDst_.width;
-        frameDst->height = frameParDst_.height;
-        frameDst->format = frameParDst_.pixFmt;
-        
-        queueFrameRaw_.pop(frameSrc);
-        int ret = av_image_alloc(frameDst->data,
-            frameDst->linesize, 
-            frameDst->width, 
-            frameDst->height, 
-            frameParDst_.pixFmt, 
-            32);
-        if (ret < 0) {
-            char errBuf[256];
-			av_strerror(ret, errBuf, sizeof(errBuf));
-			std::cerr << "[Video Renderer] Failed to allocate image buffer" 
-                << errBuf << std::endl;
-			return;
+        // Destination first: whoever holds a sequence number can finish
+        // it, frames waiting in reorder_ never starve the one they need.
+        // Waiting for a free frame is backpressure from downstream
+        int64_t begin = Timer::nowUs();
+        auto frameDst = poolFrameDst_.acquire(state_.running);
+        if (!frameDst) {
+            break;
+        }
+        int64_t acquired = Timer::nowUs();
+        std::shared_ptr<AVFrame> frameSrc;
+        uint64_t seq = 0;
+        bool stale = false;
+        {
+            std::lock_guard<std::mutex> lock(mutexInput_);
+            if (!queueFrameRaw_.popFor(frameSrc, std::chrono::milliseconds(100))) {
+                waitInput += Timer::nowUs() - acquired;
+                continue;
+            }
+            seq = seqInput_++;
+            // Frames are classified in input order, a later seek marker
+            // cannot overtake them
+            if (is_flush(frameSrc.get())) {
+                serialSeek_ = serial_flush(frameSrc.get());
+            } else if (frameSrc) {
+                stale = serialSeek_ != state_.serialSeek.load();
+            }
+            gauge.sample(queueFrameRaw_.size(), queueFrameRaw_.capacity());
+        }
+        int64_t popped = Timer::nowUs();
+        metrics.waitInput.record(waitInput + popped - acquired);
+        waitInput = 0;
+        if (!frameSrc) {
+            // End of stream, the displayer decides whether playback ends
+            deliver(seq, Rendered{nullptr, false});
+            continue;
+        }
+        if (is_flush(frameSrc.get())) {
+            // In order, behind everything rendered before it
+            deliver(seq, Rendered{std::move(frameSrc), false});
+            continue;
+        }
+        if (stale) {
+            deliver(seq, Rendered{nullptr, true});
+            continue;
+        }
+        if (!checkFrameSrc(worker, frameSrc.get())) {
+            metrics.dropped.fetch_add(1, std::memory_order_relaxed);
+            deliver(seq, Rendered{nullptr, true});
+            continue;
         }
 
-        sws_scale(ctxScaler_, 
-            frameSrc->data, frameSrc->linesize, 0, 
-            frameSrc->height, 
-            frameDst->data, frameDst->linesize);
+        if (!render(worker, frameSrc.get(), frameDst.get())) {
+            metrics.dropped.fetch_add(1, std::memory_order_relaxed);
+            deliver(seq, Rendered{nullptr, true});
+            continue;
+        }
         frameDst->pts = frameSrc->pts;
+        // Hand the decoded picture back to the decoder as early as possible
+        frameSrc.reset();
         // saveFrame(frameDst.get(), "../temp/" + std::to_string(i) + ".png");
         // i++;
-        queueFrameDst_.push(frameDst);
+        int64_t rendered = Timer::nowUs();
+        deliver(seq, Rendered{std::move(frameDst), false});
+        int64_t delivered = Timer::nowUs();
+        metrics.process.record(rendered - popped);
+        metrics.waitOutput.record(delivered - rendered + acquired - begin);
+        metrics.items.fetch_add(1, std::memory_order_relaxed);
+        metrics.accumulateCpu(cpuLast);
+    }
+}
+
+bool RendererVideo::render(Worker& worker, const AVFrame* frameSrc, AVFrame* frameDst)
+{
+    if (worker.scalerMono) {
+        worker.scalerMono->scale(frameSrc, frameDst);
+    } else if (worker.scalerNative) {
+        worker.scalerNative->scale(frameSrc, frameDst, &worker.workersScaler);
+    } else if (worker.threadedScaler) {
+        // Slice threads only run through the frame API
+        AVFrame* target = worker.frameScaled ? worker.frameScaled.get() : frameDst;
+        int ret = sws_scale_frame(worker.ctxScaler, target, frameSrc);
+        if (ret < 0) {
+            std::cerr << "[Video Renderer] Failed to scale frame: " 
+                << ffmpegErrStr(ret) << std::endl;
+            return false;
+        }
+        if (worker.frameScaled) {
+            screen_->packFrame(worker.frameScaled.get(), frameDst);
+        }
+    } else if (worker.frameScaled) {
+        sws_scale(worker.ctxScaler, 
+            frameSrc->data, frameSrc->linesize, 0, 
+            frameSrc->height, 
+            worker.frameScaled->data, worker.frameScaled->linesize);
+        screen_->packFrame(worker.frameScaled.get(), frameDst);
+    } else {
+        sws_scale(worker.ctxScaler, 
+            frameSrc->data, frameSrc->linesize, 0, 
+            frameSrc->height, 
+            frameDst->data, frameDst->linesize);
+    }
+    return true;
+}
+
+// Frames leave in the order they arrived, whichever worker finishes first
+void RendererVideo::deliver(uint64_t seq, Rendered rendered)
+{
+    std::lock_guard<std::mutex> lock(mutexReorder_);
+    reorder_.emplace(seq, std::move(rendered));
+    for (auto it = reorder_.begin(); 
+        it != reorder_.end() && it->first == seqOutput_; 
+        it = reorder_.erase(it)) {
+        seqOutput_++;
+        if (!it->second.skip) {
+            // nullptr passes on the end of stream
+            queueFrameDst_.push(std::move(it->second.frame));
+        }
     }
 }
 
 // Dependencies: DisplayerVideo
-bool RendererVideo::setScalerVideo()
+bool RendererVideo::setScalerVideo(Worker& worker)
 {
-    if (frameParSrc_.width <= 0 || 
-        frameParSrc_.height <= 0 || 
+    if (worker.widthSrc <= 0 || 
+        worker.heightSrc <= 0 || 
         frameParDst_.width <= 0 ||
         frameParDst_.height <= 0)
     {
@@ -80,9 +244,64 @@ bool RendererVideo::setScalerVideo()
             << std::endl;
         return false; 
     }
-    ctxScaler_ = sws_getContext(frameParSrc_.width, 
-        frameParSrc_.height, 
-        frameParSrc_.pixFmt, 
+    if (setScalerMono(worker) || setScalerNative(worker)) {
+        return true;
+    }
+    worker.workersScaler.stop();
+    return setScalerSwscale(worker);
+}
+
+bool RendererVideo::setScalerSwscale(Worker& worker)
+{
+    int threads = countThreadsScaler();
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frameParDst_.pixFmt);
+    if (config_.flagsDither == SWS_DITHER_ED 
+        && desc && av_get_bits_per_pixel(desc) <= 8) {
+        // Error diffusion carries over rows, slices would change the output
+        threads = 1;
+    }
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+    if (threads > 1) {
+        sws_freeContext(worker.ctxScaler);
+        worker.ctxScaler = sws_alloc_context();
+        SwsContext* ctx = worker.ctxScaler;
+        if (ctx) {
+            av_opt_set_int(ctx, "srcw", worker.widthSrc, 0);
+            av_opt_set_int(ctx, "srch", worker.heightSrc, 0);
+            av_opt_set_int(ctx, "src_format", worker.pixFmtSrc, 0);
+            av_opt_set_int(ctx, "dstw", frameParDst_.width, 0);
+            av_opt_set_int(ctx, "dsth", frameParDst_.height, 0);
+            av_opt_set_int(ctx, "dst_format", frameParDst_.pixFmt, 0);
+            av_opt_set_int(ctx, "sws_flags", config_.flagsScaler, 0);
+            av_opt_set_int(ctx, "dither", config_.flagsDither, 0);
+            av_opt_set_int(ctx, "threads", threads, 0);
+            if (sws_init_context(ctx, nullptr, nullptr) < 0) {
+                sws_freeContext(ctx);
+                worker.ctxScaler = nullptr;
+            }
+        }
+        worker.threadedScaler = worker.ctxScaler != nullptr;
+        if (!worker.ctxScaler) {
+            std::cerr << "[Video Renderer] Failed to create scaler" << std::endl;
+            return false;
+        }
+        if (worker.index == 0) {
+            std::cout << "[Video Renderer] swscale with " << threads 
+                << " slice threads" << std::endl;
+        }
+        return true;
+    }
+#endif
+    if (worker.threadedScaler) {
+        // The cached lookup would hand back the threaded context
+        sws_freeContext(worker.ctxScaler);
+        worker.ctxScaler = nullptr;
+        worker.threadedScaler = false;
+    }
+    worker.ctxScaler = sws_getCachedContext(worker.ctxScaler, 
+        worker.widthSrc, 
+        worker.heightSrc, 
+        worker.pixFmtSrc, 
         frameParDst_.width, 
         frameParDst_.height, 
         frameParDst_.pixFmt, 
@@ -90,12 +309,107 @@ bool RendererVideo::setScalerVideo()
         nullptr, 
         nullptr, 
         nullptr);
-    if (!ctxScaler_) {
+    if (!worker.ctxScaler) {
         std::cerr << "[Video Renderer] Failed to create scaler" << std::endl;
         return false;
     }
-    av_opt_set_int(ctxScaler_, "dither", config_.flagsDither, 0);
+    av_opt_set_int(worker.ctxScaler, "dither", config_.flagsDither, 0);
+    return true;
+}
+
+// Fused scale/convert for 4:2:0 into RGB565BE, false to use swscale
+bool RendererVideo::setScalerNative(Worker& worker)
+{
+    if (config_.renderKernel != RenderKernel::Native
+        || !ScalerRGB565::isSupported(worker.pixFmtSrc, frameParDst_.pixFmt)) {
+        worker.scalerNative.reset();
+        return false;
+    }
+    if (!worker.scalerNative) {
+        worker.scalerNative = std::make_unique<ScalerRGB565>();
+    }
+    const int threads = std::min(countThreadsScaler(), frameParDst_.height.load());
+    if (worker.workersScaler.count() != threads) {
+        worker.workersScaler.start(threads);
+    }
+    if (!worker.scalerNative->init(worker.widthSrc, worker.heightSrc, 
+        worker.pixFmtSrc, frameParDst_.width, frameParDst_.height, threads)) {
+        if (worker.index == 0) {
+            std::cout << "[Video Renderer] Native kernel can not take this ratio, "
+                << "using swscale" << std::endl;
+        }
+        worker.scalerNative.reset();
+        return false;
+    }
+    if (worker.index == 0) {
+        std::cout << "[Video Renderer] Native RGB565 kernel (" 
+            << ScalerRGB565::getKernelName() << ", " << threads << " slices)" 
+            << std::endl;
+    }
+    return true;
+}
+
+// Configured slice count, 0 shares the cores among the render workers
+int RendererVideo::countThreadsScaler() const
+{
+    int count = config_.countThreadsScaler;
+    if (count <= 0) {
+        count = std::min(static_cast<int>(std::thread::hardware_concurrency()), 
+            MAX_THREADS_SCALER_AUTO) / std::max(config_.countWorkersRenderer.load(), 1);
+    }
+    return std::max(count, 1);
+}
+
+// Luma straight into the panel pages, false to use swscale and packFrame
+bool RendererVideo::setScalerMono(Worker& worker)
+{
+    PageMap map;
+    if (config_.renderKernel != RenderKernel::Native || !screen_ 
+        || !screen_->getNativeLayout().pagePacked || !screen_->getPageMap(map)
+        || !ScalerMono::isSupported(worker.pixFmtSrc)) {
+        worker.scalerMono.reset();
+        return false;
+    }
+    if (!worker.scalerMono) {
+        worker.scalerMono = std::make_unique<ScalerMono>();
+    }
+    if (!worker.scalerMono->init(worker.widthSrc, worker.heightSrc, 
+        worker.pixFmtSrc, frameParDst_.width, frameParDst_.height, 
+        screen_->getNativeLayout(), map, config_.ditherMono)) {
+        if (worker.index == 0) {
+            std::cout << "[Video Renderer] Mono kernel can not take this ratio, "
+                << "using swscale" << std::endl;
+        }
+        worker.scalerMono.reset();
+        return false;
+    }
+    if (worker.index == 0) {
+        std::cout << "[Video Renderer] Native mono kernel (" 
+            << BoxFilter::getKernelName() << ")" << std::endl;
+    }
     return true;
 }
 
-}
\ No newline at end of file
+// The decoder may deliver another size than announced (lowres, mid-stream
+// resolution change), follow it instead of scaling garbage
+bool RendererVideo::checkFrameSrc(Worker& worker, const AVFrame* frame)
+{
+    if (frame->width == worker.widthSrc && 
+        frame->height == worker.heightSrc && 
+        frame->format == worker.pixFmtSrc) {
+        return true;
+    }
+    if (worker.index == 0) {
+        std::cout << "[Video Renderer] Source changed to " << frame->width << "x" 
+            << frame->height << ", rebuilding scaler" << std::endl;
+    }
+    worker.widthSrc = frame->width;
+    worker.heightSrc = frame->height;
+    worker.pixFmtSrc = static_cast<AVPixelFormat>(frame->format);
+    frameParSrc_.width = frame->width;
+    frameParSrc_.height = frame->height;
+    frameParSrc_.pixFmt = worker.pixFmtSrc;
+    return setScalerVideo(worker);
+}
+
+}
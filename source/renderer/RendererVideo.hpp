@@ -3,34 +3,107 @@
 #include "common.hpp"
 #include "ffmpeg.hpp"
 
+#include <map>
+
+#include "FramePool.hpp"
+#include "IDisplayer.hpp"
+#include "ScalerMono.hpp"
+#include "ScalerRGB565.hpp"
+#include "SliceWorkers.hpp"
+#include "Telemetry.hpp"
+
 namespace bplayer {
 
 class RendererVideo {
 public:
-    RendererVideo(BlockingQueue<std::shared_ptr<AVFrame>>& queueFrameRaw, 
-        BlockingQueue<std::shared_ptr<AVFrame>>& queueFrameDst, 
+    RendererVideo(PipeQueue<std::shared_ptr<AVFrame>>& queueFrameRaw, 
+        PipeQueue<std::shared_ptr<AVFrame>>& queueFrameDst, 
         PlayerState& state, 
         PlayerConfig& config, 
+        Telemetry& telemetry,
         FrameParameter& frameParSrc, 
         FrameParameter& frameParDst);
     ~RendererVideo();
 
-    bool init();
+    // "screen" provides the transfer buffers, nullptr renders into
+    // plain frames in frameParDst_ format
+    bool init(IDisplayer* screen = nullptr);
     void run();
 
 private:
-    BlockingQueue<std::shared_ptr<AVFrame>>& queueFrameRaw_;
-    BlockingQueue<std::shared_ptr<AVFrame>>& queueFrameDst_;
+    // Destination frames alive outside queueFrameDst_: one being rendered,
+    // one held by the displayer, one kept by the driver for diffing;
+    // the driver's transmit buffers may hold one more each
+    static constexpr size_t FRAMES_IN_FLIGHT = 3;
+    // Upper bound of the automatic scaler thread count
+    static constexpr int MAX_THREADS_SCALER_AUTO = 4;
+
+    // Conversion state of one render worker, scalers are not shared
+    struct Worker {
+        size_t index = 0;
+        // Source the scalers were built for
+        int widthSrc = 0;
+        int heightSrc = 0;
+        AVPixelFormat pixFmtSrc = AV_PIX_FMT_NONE;
+        SwsContext* ctxScaler = nullptr;
+        // ctxScaler has slice threads, drive it with sws_scale_frame()
+        bool threadedScaler = false;
+        // Fused kernel replacing ctxScaler when RenderKernel::Native applies
+        std::unique_ptr<ScalerRGB565> scalerNative;
+        // Luma-only kernel writing straight into page packed panel buffers
+        std::unique_ptr<ScalerMono> scalerMono;
+        // Stripes of the native RGB565 kernel
+        SliceWorkers workersScaler;
+        // Scaler output when the panel layout needs a packing pass
+        std::shared_ptr<AVFrame> frameScaled;
+
+        ~Worker() {
+            sws_freeContext(ctxScaler);
+        }
+    };
+
+    // Rendered frame waiting for its turn in queueFrameDst_
+    struct Rendered {
+        std::shared_ptr<AVFrame> frame;
+        // Dropped frame, only its sequence number is consumed
+        bool skip = false;
+    };
+
+    PipeQueue<std::shared_ptr<AVFrame>>& queueFrameRaw_;
+    PipeQueue<std::shared_ptr<AVFrame>>& queueFrameDst_;
 
     PlayerState& state_;
     PlayerConfig& config_;
+    Telemetry& telemetry_;
 
     FrameParameter& frameParSrc_;
     FrameParameter& frameParDst_;
 
-    SwsContext* ctxScaler_ = nullptr;
+    FramePool poolFrameDst_;
+    IDisplayer* screen_ = nullptr;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Both queues have a single consumer / producer: workers pop under
+    // mutexInput_, which also numbers the frames, and push under
+    // mutexReorder_ in that order
+    std::mutex mutexInput_;
+    uint64_t seqInput_ = 0;
+    // Serial of the last seek marker popped, under mutexInput_
+    uint64_t serialSeek_ = 0;
+    std::mutex mutexReorder_;
+    std::map<uint64_t, Rendered> reorder_;
+    uint64_t seqOutput_ = 0;
 
-    bool setScalerVideo();
+    void runWorker(Worker& worker);
+    // False when the destination was not written and must not be shown
+    bool render(Worker& worker, const AVFrame* frameSrc, AVFrame* frameDst);
+    void deliver(uint64_t seq, Rendered rendered);
+    int countThreadsScaler() const;
+    bool setScalerVideo(Worker& worker);
+    bool setScalerSwscale(Worker& worker);
+    bool setScalerNative(Worker& worker);
+    bool setScalerMono(Worker& worker);
+    bool checkFrameSrc(Worker& worker, const AVFrame* frame);
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "ScalerMono.hpp"
+
+namespace bplayer
+{
+
+// 8x8 Bayer matrix, thresholds 0..63
+static constexpr uint8_t BAYER8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+ScalerMono::ScalerMono()
+{
+
+}
+
+ScalerMono::~ScalerMono()
+{
+
+}
+
+bool ScalerMono::isSupported(AVPixelFormat pixFmtSrc)
+{
+    switch (pixFmtSrc) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_YUVJ422P:
+    case AV_PIX_FMT_YUV444P:
+    case AV_PIX_FMT_YUVJ444P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+    case AV_PIX_FMT_GRAY8:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool ScalerMono::init(int widthSrc, int heightSrc, AVPixelFormat pixFmtSrc,
+    int widthDst, int heightDst, const FrameLayout& layout,
+    const PageMap& map, DitherMono dither)
+{
+    if (!isSupported(pixFmtSrc) || !layout.pagePacked 
+        || !luma_.init(widthSrc, heightSrc, widthDst, heightDst)) {
+        return false;
+    }
+    widthDst_ = widthDst;
+    heightDst_ = heightDst;
+    pixFmtSrc_ = pixFmtSrc;
+    layout_ = layout;
+    map_ = map;
+    dither_ = dither;
+    lutValid_ = false;
+    row_.assign(widthDst, 0);
+    errors_.assign(static_cast<size_t>(ROWS_ERROR) * (widthDst + 2 * PAD_ERROR), 0);
+    return true;
+}
+
+void ScalerMono::scale(const AVFrame* src, AVFrame* dst)
+{
+    updateLut(src->color_range);
+    uint8_t* pages = dst->data[0];
+    std::memset(pages, 0, layout_.sizePixels());
+    std::fill(errors_.begin(), errors_.end(), 0);
+    for (int y = 0; y < heightDst_; y++) {
+        const uint16_t* acc = luma_.accumulate(src->data[0], src->linesize[0], y);
+        for (int x = 0; x < widthDst_; x++) {
+            row_[x] = lut_[luma_.average(acc, y, x)];
+        }
+        ditherRow(y, pages);
+    }
+}
+
+// Full range for "J" formats, gray and JPEG range frames
+void ScalerMono::updateLut(AVColorRange range)
+{
+    if (lutValid_ && range == range_) {
+        return;
+    }
+    range_ = range;
+    lutValid_ = true;
+    const bool full = range == AVCOL_RANGE_JPEG 
+        || pixFmtSrc_ == AV_PIX_FMT_YUVJ420P || pixFmtSrc_ == AV_PIX_FMT_YUVJ422P
+        || pixFmtSrc_ == AV_PIX_FMT_YUVJ444P || pixFmtSrc_ == AV_PIX_FMT_GRAY8;
+    for (int v = 0; v < 256; v++) {
+        lut_[v] = full ? static_cast<uint8_t>(v) 
+            : static_cast<uint8_t>(std::clamp((v - 16) * 255 / 219, 0, 255));
+    }
+}
+
+// Error row of output row "y", padded so that x - 2 .. x + 2 are valid
+int16_t* ScalerMono::rowError(int y)
+{
+    return errors_.data() + static_cast<size_t>(y % ROWS_ERROR) 
+        * (widthDst_ + 2 * PAD_ERROR) + PAD_ERROR;
+}
+
+void ScalerMono::ditherRow(int y, uint8_t* pages)
+{
+    switch (dither_) {
+    case DitherMono::Threshold:
+        for (int x = 0; x < widthDst_; x++) {
+            if (row_[x] >= 128) {
+                setPixel(pages, x, y);
+            }
+        }
+        break;
+    case DitherMono::Bayer: {
+        const uint8_t* bayer = BAYER8[y & 7];
+        for (int x = 0; x < widthDst_; x++) {
+            if (row_[x] > bayer[x & 7] * 4 + 1) {
+                setPixel(pages, x, y);
+            }
+        }
+        break;
+    }
+    case DitherMono::FloydSteinberg: {
+        int16_t* cur = rowError(y);
+        int16_t* next = rowError(y + 1);
+        std::fill(next - PAD_ERROR, next + widthDst_ + PAD_ERROR, 0);
+        for (int x = 0; x < widthDst_; x++) {
+            int v = row_[x] + cur[x];
+            int err = v;
+            if (v >= 128) {
+                setPixel(pages, x, y);
+                err = v - 255;
+            }
+            cur[x + 1] += static_cast<int16_t>(err * 7 / 16);
+            next[x - 1] += static_cast<int16_t>(err * 3 / 16);
+            next[x] += static_cast<int16_t>(err * 5 / 16);
+            next[x + 1] += static_cast<int16_t>(err / 16);
+        }
+        break;
+    }
+    case DitherMono::Atkinson: {
+        int16_t* cur = rowError(y);
+        int16_t* next = rowError(y + 1);
+        int16_t* after = rowError(y + 2);
+        std::fill(after - PAD_ERROR, after + widthDst_ + PAD_ERROR, 0);
+        for (int x = 0; x < widthDst_; x++) {
+            int v = row_[x] + cur[x];
+            int err = v;
+            if (v >= 128) {
+                setPixel(pages, x, y);
+                err = v - 255;
+            }
+            const int16_t part = static_cast<int16_t>(err / 8);
+            cur[x + 1] += part;
+            cur[x + 2] += part;
+            next[x - 1] += part;
+            next[x] += part;
+            next[x + 1] += part;
+            after[x] += part;
+        }
+        break;
+    }
+    }
+}
+
+// Lit pixel: bit (row % 8) of the byte at (column, row / 8)
+inline void ScalerMono::setPixel(uint8_t* pages, int x, int y) const
+{
+    const int col = map_.col0 + x * map_.colX + y * map_.colY;
+    const int row = map_.row0 + x * map_.rowX + y * map_.rowY;
+    if (col < 0 || col >= layout_.stride || row < 0 || row >= layout_.rows * 8) {
+        return;
+    }
+    pages[(row >> 3) * layout_.stride + col] |= static_cast<uint8_t>(1 << (row & 7));
+}
+
+}
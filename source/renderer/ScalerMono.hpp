@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+#include "BoxFilter.hpp"
+#include "IDisplayer.hpp"
+
+namespace bplayer
+{
+
+// Luma only monochrome renderer for page packed panels
+// Only the Y plane is read: it is box filtered onto the display area
+// (see BoxFilter), dithered and written as bits straight into the
+// panel's pages through its PageMap, so neither chroma nor a separate
+// packing pass is touched.
+class ScalerMono {
+public:
+    ScalerMono();
+    ~ScalerMono();
+
+    // Formats with 8 bit luma in plane 0
+    static bool isSupported(AVPixelFormat pixFmtSrc);
+
+    // "layout" is the panel's page buffer, "map" places the area in it
+    bool init(int widthSrc, int heightSrc, AVPixelFormat pixFmtSrc,
+        int widthDst, int heightDst, const FrameLayout& layout,
+        const PageMap& map, DitherMono dither);
+    // "dst" data[0] is the page buffer, cleared and filled
+    void scale(const AVFrame* src, AVFrame* dst);
+
+private:
+    // Error rows kept by the diffusion dithers (Atkinson reaches y + 2)
+    static constexpr int ROWS_ERROR = 3;
+    // Columns of padding on both sides of an error row
+    static constexpr int PAD_ERROR = 2;
+
+    int widthDst_ = 0;
+    int heightDst_ = 0;
+    AVPixelFormat pixFmtSrc_ = AV_PIX_FMT_NONE;
+    FrameLayout layout_;
+    PageMap map_;
+    DitherMono dither_ = DitherMono::FloydSteinberg;
+    BoxFilter luma_;
+    // Luma to 0..255 brightness, expands limited range
+    uint8_t lut_[256];
+    AVColorRange range_ = AVCOL_RANGE_UNSPECIFIED;
+    bool lutValid_ = false;
+    // Brightness of the current output row
+    std::vector<int16_t> row_;
+    std::vector<int16_t> errors_;
+
+    void updateLut(AVColorRange range);
+    void ditherRow(int y, uint8_t* pages);
+    int16_t* rowError(int y);
+    inline void setPixel(uint8_t* pages, int x, int y) const;
+};
+
+}
@@ -0,0 +1,158 @@
+#include "ScalerRGB565.hpp"
+
+namespace bplayer
+{
+
+// 4x4 Bayer matrix, thresholds 0..15
+static constexpr uint8_t BAYER4[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5},
+};
+
+ScalerRGB565::ScalerRGB565()
+{
+
+}
+
+ScalerRGB565::~ScalerRGB565()
+{
+
+}
+
+bool ScalerRGB565::isSupported(AVPixelFormat pixFmtSrc, AVPixelFormat pixFmtDst)
+{
+    return (pixFmtSrc == AV_PIX_FMT_YUV420P || pixFmtSrc == AV_PIX_FMT_YUVJ420P)
+        && pixFmtDst == AV_PIX_FMT_RGB565BE;
+}
+
+const char* ScalerRGB565::getKernelName()
+{
+    return BoxFilter::getKernelName();
+}
+
+bool ScalerRGB565::init(int widthSrc, int heightSrc, AVPixelFormat pixFmtSrc,
+    int widthDst, int heightDst, int countSlices)
+{
+    if (widthSrc <= 0 || heightSrc <= 0 || widthDst <= 0 || heightDst <= 0
+        || !isSupported(pixFmtSrc, AV_PIX_FMT_RGB565BE)) {
+        return false;
+    }
+    widthSrc_ = widthSrc;
+    heightSrc_ = heightSrc;
+    widthDst_ = widthDst;
+    heightDst_ = heightDst;
+    pixFmtSrc_ = pixFmtSrc;
+    matrixValid_ = false;
+    const int count = std::clamp(countSlices, 1, heightDst);
+    slices_.clear();
+    slices_.resize(count);
+    for (int i = 0; i < count; i++) {
+        Slice& slice = slices_[i];
+        slice.y0 = heightDst * i / count;
+        slice.y1 = heightDst * (i + 1) / count;
+        if (!slice.luma.init(widthSrc, heightSrc, widthDst, heightDst)
+            || !slice.chroma.init((widthSrc + 1) / 2, (heightSrc + 1) / 2,
+                widthDst, heightDst, 2)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ScalerRGB565::scale(const AVFrame* src, AVFrame* dst, SliceWorkers* workers)
+{
+    updateMatrix(src->colorspace, src->color_range);
+    if (workers && slices_.size() > 1) {
+        workers->run([&](int i) {
+            if (i < static_cast<int>(slices_.size())) {
+                scaleSlice(src, dst, slices_[i]);
+            }
+        });
+        return;
+    }
+    for (Slice& slice : slices_) {
+        scaleSlice(src, dst, slice);
+    }
+}
+
+void ScalerRGB565::scaleSlice(const AVFrame* src, AVFrame* dst, Slice& slice) const
+{
+    const Matrix m = matrix_;
+    BoxFilter& luma = slice.luma;
+    BoxFilter& chroma = slice.chroma;
+    for (int y = slice.y0; y < slice.y1; y++) {
+        const uint16_t* accY = luma.accumulate(src->data[0], src->linesize[0], y);
+        const uint16_t* accU = chroma.accumulate(src->data[1], src->linesize[1], y, 0);
+        const uint16_t* accV = chroma.accumulate(src->data[2], src->linesize[2], y, 1);
+        const uint8_t* bayer = BAYER4[y & 3];
+        uint8_t* out = dst->data[0] + static_cast<ptrdiff_t>(y) * dst->linesize[0];
+        for (int x = 0; x < widthDst_; x++) {
+            const int vY = luma.average(accY, y, x);
+            const int vU = chroma.average(accU, y, x) - 128;
+            const int vV = chroma.average(accV, y, x) - 128;
+
+            const int32_t l = (vY - m.offsetY) * m.y + (1 << (SHIFT_MATRIX - 1));
+            int r = (l + m.crR * vV) >> SHIFT_MATRIX;
+            int g = (l + m.cbG * vU + m.crG * vV) >> SHIFT_MATRIX;
+            int b = (l + m.cbB * vU) >> SHIFT_MATRIX;
+            // Threshold below one quantization step: 8 for R/B, 4 for G
+            const int t = bayer[x & 3];
+            r = std::clamp(r + (t >> 1), 0, 255) >> 3;
+            g = std::clamp(g + (t >> 2), 0, 255) >> 2;
+            b = std::clamp(b + (t >> 1), 0, 255) >> 3;
+            out[2 * x] = static_cast<uint8_t>((r << 3) | (g >> 3));
+            out[2 * x + 1] = static_cast<uint8_t>(((g & 0x07) << 5) | b);
+        }
+    }
+}
+
+// Same matrices swscale applies by default: BT.601 unless the frame says
+// otherwise, limited range unless JPEG range or a "J" format
+void ScalerRGB565::updateMatrix(AVColorSpace colorspace, AVColorRange range)
+{
+    if (matrixValid_ && colorspace == colorspace_ && range == range_) {
+        return;
+    }
+    colorspace_ = colorspace;
+    range_ = range;
+    matrixValid_ = true;
+
+    double kr = 0.299;
+    double kb = 0.114;
+    switch (colorspace) {
+    case AVCOL_SPC_BT709:
+        kr = 0.2126;
+        kb = 0.0722;
+        break;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        kr = 0.2627;
+        kb = 0.0593;
+        break;
+    case AVCOL_SPC_SMPTE240M:
+        kr = 0.212;
+        kb = 0.087;
+        break;
+    case AVCOL_SPC_FCC:
+        kr = 0.30;
+        kb = 0.11;
+        break;
+    default:
+        break;
+    }
+    const double kg = 1.0 - kr - kb;
+    const bool full = range == AVCOL_RANGE_JPEG || pixFmtSrc_ == AV_PIX_FMT_YUVJ420P;
+    const double scaleY = full ? 1.0 : 255.0 / 219.0;
+    const double scaleC = full ? 1.0 : 255.0 / 224.0;
+    const double one = static_cast<double>(1 << SHIFT_MATRIX);
+    matrix_.offsetY = full ? 0 : 16;
+    matrix_.y = static_cast<int32_t>(std::lround(scaleY * one));
+    matrix_.crR = static_cast<int32_t>(std::lround(2.0 * (1.0 - kr) * scaleC * one));
+    matrix_.cbB = static_cast<int32_t>(std::lround(2.0 * (1.0 - kb) * scaleC * one));
+    matrix_.cbG = static_cast<int32_t>(std::lround(-2.0 * kb * (1.0 - kb) / kg * scaleC * one));
+    matrix_.crG = static_cast<int32_t>(std::lround(-2.0 * kr * (1.0 - kr) / kg * scaleC * one));
+}
+
+}
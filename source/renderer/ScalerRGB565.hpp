@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.hpp"
+#include "ffmpeg.hpp"
+
+#include "BoxFilter.hpp"
+#include "SliceWorkers.hpp"
+
+namespace bplayer
+{
+
+// Fused downscale, YUV->RGB, ordered dither and RGB565BE packing
+// Planar 4:2:0 frames are box filtered onto the panel size in a single
+// pass over the source (see BoxFilter), then every output pixel is
+// converted, dithered with a 4x4 Bayer matrix and stored big-endian.
+// Output rows are independent, so stripes of rows can run concurrently
+// with a box filter each and the same result.
+class ScalerRGB565 {
+public:
+    ScalerRGB565();
+    ~ScalerRGB565();
+
+    static bool isSupported(AVPixelFormat pixFmtSrc, AVPixelFormat pixFmtDst);
+    // Accumulation kernel compiled in: "sse2", "neon" or "scalar"
+    static const char* getKernelName();
+
+    // False for unsupported formats or ratios, use swscale then;
+    // "countSlices" stripes are prepared for scale() with workers
+    bool init(int widthSrc, int heightSrc, AVPixelFormat pixFmtSrc,
+        int widthDst, int heightDst, int countSlices = 1);
+    // "src" must match init(), "dst" is RGB565BE of the init() size;
+    // the stripes are spread over "workers" when given
+    void scale(const AVFrame* src, AVFrame* dst, SliceWorkers* workers = nullptr);
+
+private:
+    // Fixed point of the conversion matrix
+    static constexpr int SHIFT_MATRIX = 16;
+
+    // YUV->RGB in SHIFT_MATRIX fixed point
+    struct Matrix {
+        int offsetY;
+        int32_t y;
+        int32_t crR;
+        int32_t cbG;
+        int32_t crG;
+        int32_t cbB;
+    };
+
+    // Output rows [y0, y1) with their own accumulators
+    struct Slice {
+        int y0 = 0;
+        int y1 = 0;
+        BoxFilter luma;
+        // U in slot 0, V in slot 1
+        BoxFilter chroma;
+    };
+
+    int widthSrc_ = 0;
+    int heightSrc_ = 0;
+    int widthDst_ = 0;
+    int heightDst_ = 0;
+    AVPixelFormat pixFmtSrc_ = AV_PIX_FMT_NONE;
+    std::vector<Slice> slices_;
+    Matrix matrix_{};
+    AVColorSpace colorspace_ = AVCOL_SPC_UNSPECIFIED;
+    AVColorRange range_ = AVCOL_RANGE_UNSPECIFIED;
+    bool matrixValid_ = false;
+
+    void updateMatrix(AVColorSpace colorspace, AVColorRange range);
+    void scaleSlice(const AVFrame* src, AVFrame* dst, Slice& slice) const;
+};
+
+}
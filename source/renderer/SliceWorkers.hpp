@@ -0,0 +1,116 @@
+#pragma once
+
+#include "common.hpp"
+
+#include <functional>
+
+namespace bplayer
+{
+
+// Threads rendering the slices of one frame together
+// run() hands out slice indices to the workers and to the calling thread
+// itself, and returns once every slice is done. With a count below two
+// no thread is started and the slices run inline.
+class SliceWorkers {
+public:
+    using Task = std::function<void(int slice)>;
+
+    SliceWorkers() = default;
+    ~SliceWorkers() {
+        stop();
+    }
+
+    // "count" slices per run(), count - 1 threads
+    void start(int count) {
+        stop();
+        count_ = std::max(count, 1);
+        running_ = true;
+        for (int i = 1; i < count_; i++) {
+            threads_.emplace_back(&SliceWorkers::loop, this);
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        cvStart_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+        threads_.clear();
+        count_ = 1;
+    }
+
+    int count() const {
+        return count_;
+    }
+
+    // task(0) .. task(count() - 1), not reentrant
+    void run(const Task& task) {
+        if (threads_.empty()) {
+            for (int i = 0; i < count_; i++) {
+                task(i);
+            }
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        task_ = &task;
+        next_ = 0;
+        pending_ = count_;
+        generation_++;
+        cvStart_.notify_all();
+        work(lock, generation_);
+        cvDone_.wait(lock, [&]() {
+            return pending_ == 0;
+        });
+        task_ = nullptr;
+    }
+
+private:
+    std::vector<std::thread> threads_;
+    int count_ = 1;
+    bool running_ = false;
+    // Bumped by every run(), wakes the workers
+    uint64_t generation_ = 0;
+    const Task* task_ = nullptr;
+    // Next slice to hand out and slices not finished yet
+    int next_ = 0;
+    int pending_ = 0;
+    std::mutex mutex_;
+    std::condition_variable cvStart_;
+    std::condition_variable cvDone_;
+
+    // Take slices of run "generation" until none is left; slices are
+    // claimed under the lock so a late worker never runs a stale task
+    void work(std::unique_lock<std::mutex>& lock, uint64_t generation) {
+        while (generation_ == generation && next_ < count_) {
+            const Task& task = *task_;
+            int slice = next_++;
+            lock.unlock();
+            task(slice);
+            lock.lock();
+            if (--pending_ == 0) {
+                cvDone_.notify_one();
+            }
+        }
+    }
+
+    void loop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cvStart_.wait(lock, [&]() {
+                return !running_ || generation_ != seen;
+            });
+            if (!running_) {
+                return;
+            }
+            seen = generation_;
+            work(lock, seen);
+        }
+    }
+};
+
+}